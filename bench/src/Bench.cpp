@@ -0,0 +1,128 @@
+#include "Bench.h"
+#include <stdarg.h>
+
+#pragma region Report
+
+static bool json = false;
+static const char *tag = "";
+static std::vector<const char *> selected;
+
+void benchBegin(int argc, char **argv)
+{
+    //  program [--json] [--tag name] [bench...]
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--json")) json = true;
+        else if (!strcmp(argv[i], "--tag") && (i + 1 < argc)) tag = argv[++i];
+        else selected.push_back(argv[i]);
+    }
+}
+
+bool benchSelected(const char *bench)
+{
+    if (selected.empty()) return true;
+    for (const char *name : selected)
+    {
+        if (!strcmp(name, bench)) return true;
+    }
+    return false;
+}
+
+void say(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vfprintf(json ? stderr : stdout, format, args);
+    va_end(args);
+}
+
+void result(const char *bench, const char *name, const char *metric, double value, const char *unit)
+{
+    if (!json) return;
+    printf("{\"tag\":\"%s\",\"bench\":\"%s\",\"case\":\"%s\",\"metric\":\"%s\",\"value\":%.6g,\"unit\":\"%s\"}\n",
+           tag, bench, name, metric, value, unit);
+}
+
+#pragma endregion
+
+#pragma region SimNetwork
+
+SimNetwork::SimNetwork(int clientCount, uint32_t seed)
+    : medium(seed), clients(clientCount)
+{
+    uint8_t mac[6];
+    makeMac(mac, 0x01, 0);
+    server.transport = medium.createNode(mac);
+    server.service.reset(new NowServer(server.transport));
+    nodes.push_back(&server);
+    for (int i = 0; i < clientCount; i++)
+    {
+        makeMac(mac, 0x02, i);
+        clients[i].transport = medium.createNode(mac);
+        clients[i].service.reset(new NowClient("CLIENT" + String(i), clients[i].transport));
+        nodes.push_back(&clients[i]);
+    }
+}
+
+void SimNetwork::makeMac(uint8_t *mac, uint8_t kind, uint16_t index)
+{
+    const uint8_t m[6] = {0x02, 0x00, kind, 0x00, (uint8_t)(index >> 8), (uint8_t)index};
+    memcpy(mac, m, 6);
+}
+
+void SimNetwork::begin()
+{
+    for (SimNode *node : nodes) begin(*node);
+}
+
+void SimNetwork::begin(SimNode &node)
+{
+    SimNode *n = &node;
+    node.begun = node.service->begin(
+        [this, n](String) { n->bound = true; n->boundAt = medium.millis(); },
+        [n](uint8_t *, int length) { n->received++; n->receivedBytes += length; });
+    node.nextStep = medium.millis();
+}
+
+void SimNetwork::runFor(unsigned long ms)
+{
+    unsigned long until = medium.millis() + ms;
+    while (medium.millis() < until)
+    {
+        unsigned long now = medium.millis();
+        for (SimNode *node : nodes)
+        {
+            bool woken = node->transport->takeWake();
+            if (!node->begun || (!woken && (now < node->nextStep))) continue;
+            node->nextStep = now + node->service->step();
+            node->steps++;
+        }
+        medium.advance(1);
+    }
+}
+
+bool SimNetwork::runUntilBound(unsigned long ms)
+{
+    unsigned long lastBind;
+    for (unsigned long elapsed = 0; elapsed < ms; elapsed += 10)
+    {
+        if (boundClients(lastBind) == (int)clients.size()) return true;
+        runFor(10);
+    }
+    return boundClients(lastBind) == (int)clients.size();
+}
+
+int SimNetwork::boundClients(unsigned long &lastBind)
+{
+    int bound = 0;
+    lastBind = 0;
+    for (SimNode &client : clients)
+    {
+        if (!client.bound) continue;
+        bound++;
+        if (client.boundAt > lastBind) lastBind = client.boundAt;
+    }
+    return bound;
+}
+
+#pragma endregion
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Arduino.h>
+#include <NowClient.h>
+#include <NowServer.h>
+#include <SimMedium.h>
+#include <memory>
+#include <vector>
+
+//  results go out as text, or as one JSON object per line with --json so
+//  runs can be compared across releases:
+//
+//    {"tag":"0.1.0","bench":"bind","case":"30","metric":"last_bind","value":42,"unit":"ms"}
+//
+//  with --json the text goes to stderr
+void benchBegin(int argc, char **argv);
+bool benchSelected(const char *bench);
+void say(const char *format, ...) __attribute__((format(printf, 1, 2)));
+void result(const char *bench, const char *name, const char *metric, double value, const char *unit);
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+inline uint64_t cycles() { return __rdtsc(); }
+#else
+inline uint64_t cycles() { return (uint64_t)micros() * 1000; }
+#endif
+
+//  keeps the optimizer from dropping a result that is never used
+template <typename T>
+inline void keep(const T &value) { asm volatile("" : : "g"(value) : "memory"); }
+
+struct SimNode
+{
+    std::unique_ptr<NowService> service;
+    SimTransport *transport = nullptr;
+    unsigned long nextStep = 0;
+    unsigned long steps = 0;
+    bool begun = false;
+    bool bound = false;
+    unsigned long boundAt = 0;
+    unsigned long received = 0;
+    unsigned long receivedBytes = 0;
+};
+
+//  one server and a number of clients on a shared medium
+struct SimNetwork
+{
+    SimMedium medium;
+    SimNode server;
+    std::vector<SimNode> clients;
+    std::vector<SimNode *> nodes;
+
+    SimNetwork(int clientCount, uint32_t seed = 42);
+
+    static void makeMac(uint8_t *mac, uint8_t kind, uint16_t index);
+
+    void begin();
+    void begin(SimNode &node);
+    //  each worker sleeps until its next deadline, or until a frame wakes it
+    void runFor(unsigned long ms);
+    //  until every client is bound or ms passed, false on timeout
+    bool runUntilBound(unsigned long ms);
+    int boundClients(unsigned long &lastBind);
+};
+
+//  protocol hot paths, timed in-process without the medium
+void benchMessages();
+void benchHelpers();
+void benchDispatch();
@@ -0,0 +1,236 @@
+#include "Bench.h"
+#include <Helpers.h>
+#include <NowFragment.h>
+#include <chrono>
+
+#pragma region Timing
+
+static const int batchSize = 256;
+
+//  ns per call of op, run in batches so between() can let the medium drain
+//  what the calls sent without being timed
+template <typename Op>
+static double timeOp(int count, Op op, const std::function<void()> &between = nullptr)
+{
+    using Clock = std::chrono::steady_clock;
+    Clock::duration total{};
+    for (int done = 0; done < count; done += batchSize)
+    {
+        int n = (count - done < batchSize) ? count - done : batchSize;
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < n; i++) op(done + i);
+        total += Clock::now() - start;
+        if (between) between();
+    }
+    return std::chrono::duration<double, std::nano>(total).count() / count;
+}
+
+static void report(const char *bench, const char *name, double ns)
+{
+    say("%s: %-24s %8.1fns\n", bench, name, ns);
+    result(bench, name, "time", ns, "ns");
+}
+
+#pragma endregion
+
+#pragma region Messages
+
+void benchMessages()
+{
+    const int count = 2000000;
+    const uint8_t from[6] = {0x02, 0x00, 0x02, 0x00, 0x00, 0x01};
+    const uint8_t to[6] = {0x02, 0x00, 0x01, 0x00, 0x00, 0x00};
+    uint8_t payload[NOW_MAX_PAYLOAD];
+    for (size_t i = 0; i < sizeof(payload); i++) payload[i] = (uint8_t)i;
+    static NowMsg m;
+
+    report("messages", "buildMsg 0", timeOp(count, [&](int) {
+        keep(buildMsg(m, NOW_DT_HEARTBEAT, from, to, nullptr, 0));
+    }));
+    report("messages", "buildMsg 32", timeOp(count, [&](int) {
+        keep(buildMsg(m, NOW_DT_DATA, from, to, payload, 32));
+    }));
+    report("messages", "buildMsg max", timeOp(count, [&](int) {
+        keep(buildMsg(m, NOW_DT_DATA, from, to, payload, NOW_MAX_PAYLOAD));
+    }));
+
+    buildMsg(m, NOW_DT_DATA, from, to, payload, 32);
+    report("messages", "sealMsg 32", timeOp(count, [&](int i) {
+        m.seq = (uint16_t)i;
+        sealMsg(m);
+        keep(m.crc);
+    }));
+
+    //  what a received frame costs before it is dispatched - ours, ours
+    //  but damaged, and other ESP-NOW traffic
+    static NowMsg full;
+    buildMsg(full, NOW_DT_DATA, from, to, payload, NOW_MAX_PAYLOAD);
+    sealMsg(full);
+    buildMsg(m, NOW_DT_DATA, from, to, payload, 32);
+    sealMsg(m);
+    const uint8_t *frame = reinterpret_cast<const uint8_t *>(&m);
+    int length = msgSize(m);
+    report("messages", "checkMsg 32", timeOp(count, [&](int i) {
+        keep(checkMsg(frame, length));
+    }));
+    report("messages", "checkMsg max", timeOp(count, [&](int i) {
+        keep(checkMsg(reinterpret_cast<const uint8_t *>(&full), sizeof(full)));
+    }));
+    static NowMsg corrupt;
+    corrupt = m;
+    corrupt.payload[7] ^= 0x10;
+    report("messages", "checkMsg corrupt", timeOp(count, [&](int i) {
+        keep(checkMsg(reinterpret_cast<const uint8_t *>(&corrupt), length));
+    }));
+    static uint8_t foreign[250];
+    for (size_t i = 0; i < sizeof(foreign); i++) foreign[i] = (uint8_t)(i * 37 + 11);
+    report("messages", "checkMsg foreign", timeOp(count, [&](int i) {
+        keep(checkMsg(foreign, sizeof(foreign)));
+    }));
+    report("messages", "checkMsg bad length", timeOp(count, [&](int i) {
+        keep(checkMsg(frame, length - 1));
+    }));
+    uint64_t start = cycles();
+    uint16_t crc = 0;
+    for (int i = 0; i < count / 10; i++) crc = nowCrc16(crc, payload, NOW_MAX_PAYLOAD);
+    keep(crc);
+    double crcCycles = (double)(cycles() - start) / ((double)count / 10 * NOW_MAX_PAYLOAD);
+    say("messages: %-24s %8.2f cycles/byte\n", "nowCrc16", crcCycles);
+    result("messages", "nowCrc16", "cost", crcCycles, "cycles/byte");
+
+    static NowMsgLegacy legacy;
+    memset(&legacy, 0, sizeof(legacy));
+    legacy.datatype = NOW_DT_DATA;
+    legacy.length = 32;
+    NowMsg scratch;
+    report("messages", "decodeMsg", timeOp(count, [&](int i) {
+        keep(decodeMsg(frame, length, scratch));
+    }));
+    //  rejected unless built with NOW_ACCEPT_LEGACY
+    report("messages", "decodeMsg legacy", timeOp(count, [&](int i) {
+        keep(decodeMsg(reinterpret_cast<const uint8_t *>(&legacy), sizeof(legacy), scratch));
+    }));
+}
+
+#pragma endregion
+
+#pragma region Helpers
+
+void benchHelpers()
+{
+    const int count = 1000000;
+    uint8_t mac[6] = {0x24, 0x6f, 0x28, 0xa1, 0xb2, 0xc3};
+    uint8_t other[6] = {0x24, 0x6f, 0x28, 0xa1, 0xb2, 0xc4};
+    uint8_t out[6];
+    String text = Helpers::macToString(mac);
+
+    report("helpers", "macToString", timeOp(count, [&](int i) {
+        mac[5] = (uint8_t)i;
+        keep(Helpers::macToString(mac).length());
+    }));
+    report("helpers", "parseMac string", timeOp(count, [&](int i) {
+        Helpers::parseMac(text, out);
+        keep(out[5]);
+    }));
+    report("helpers", "parseMac bytes", timeOp(count, [&](int i) {
+        mac[5] = (uint8_t)i;
+        Helpers::parseMac(mac, out);
+        keep(out[5]);
+    }));
+    report("helpers", "macEquals", timeOp(count, [&](int i) {
+        other[5] = (uint8_t)i;
+        keep(Helpers::macEquals(mac, other));
+    }));
+    report("helpers", "macToKey", timeOp(count, [&](int i) {
+        mac[5] = (uint8_t)i;
+        keep(Helpers::macToKey(mac));
+    }));
+}
+
+#pragma endregion
+
+#pragma region Dispatch
+
+//  dataReceived as the worker calls it, per datatype, against a bound pair.
+//  Replies go out on the medium, which runs between batches.
+void benchDispatch()
+{
+    const int count = 200000;
+    SimNetwork net(1);
+    net.begin();
+    net.runUntilBound(5000);
+    NowService *server = net.server.service.get();
+    NowService *client = net.clients[0].service.get();
+    uint8_t serverMac[6], clientMac[6], strangerMac[6];
+    SimNetwork::makeMac(serverMac, 0x01, 0);
+    SimNetwork::makeMac(clientMac, 0x02, 0);
+    SimNetwork::makeMac(strangerMac, 0x03, 0);
+    auto drain = [&]() { net.runFor(1); };
+
+    NowMsg m;
+    uint8_t payload[32] = {0};
+    auto frame = [&](uint8_t datatype, const uint8_t *from, const uint8_t *to, const void *data, int length) {
+        buildMsg(m, datatype, from, to, data, length);
+        sealMsg(m);
+    };
+    auto feed = [&](NowService *service, const uint8_t *mac) {
+        return [&m, service, mac](int) { service->dataReceived(mac, reinterpret_cast<const uint8_t *>(&m), msgSize(m)); };
+    };
+
+    //  server side
+    frame(NOW_DT_ADVERTISE, strangerMac, serverMac, "STRANGER", 8);
+    report("dispatch", "server advertise", timeOp(count, feed(server, strangerMac), drain));
+    frame(NOW_DT_HANDSHAKE, clientMac, serverMac, nullptr, 0);
+    report("dispatch", "server handshake", timeOp(count, feed(server, clientMac), drain));
+    frame(NOW_DT_HEARTBEAT, clientMac, serverMac, nullptr, 0);
+    report("dispatch", "server heartbeat", timeOp(count, feed(server, clientMac), drain));
+    frame(NOW_DT_DATA, clientMac, serverMac, payload, sizeof(payload));
+    report("dispatch", "server data", timeOp(count, feed(server, clientMac), drain));
+
+    //  two fragment messages, each call feeds the next fragment
+    static NowMsg fragments[512];
+    uint16_t totalLength = NOW_FRAGMENT_DATA + 32;
+    for (int i = 0; i < 512; i++)
+    {
+        NowFragment f{};
+        f.msgId = (uint16_t)(i >> 1);
+        f.totalLength = totalLength;
+        f.index = (uint8_t)(i & 1);
+        f.count = fragmentCount(totalLength);
+        int length = NOW_FRAGMENT_HEADER + fragmentLength(totalLength, f.index);
+        frame(NOW_DT_FRAGMENT, clientMac, serverMac, &f, length);
+        fragments[i] = m;
+    }
+    report("dispatch", "server fragment", timeOp(count, [&](int i) {
+        const NowMsg &f = fragments[i & 511];
+        server->dataReceived(clientMac, reinterpret_cast<const uint8_t *>(&f), msgSize(f));
+    }, drain));
+
+    NowDataAck ack{};
+    frame(NOW_DT_DATA_ACK, clientMac, serverMac, &ack, sizeof(ack));
+    report("dispatch", "server data ack", timeOp(count, feed(server, clientMac), drain));
+    frame(NOW_DT_DATA, strangerMac, serverMac, payload, sizeof(payload));
+    report("dispatch", "server data unbound", timeOp(count, feed(server, strangerMac), drain));
+    memset(&m, 0xa5, sizeof(m));
+    report("dispatch", "server foreign", timeOp(count, [&](int) {
+        server->dataReceived(clientMac, reinterpret_cast<const uint8_t *>(&m), 40);
+    }, drain));
+    frame(NOW_DT_DATA, clientMac, serverMac, payload, sizeof(payload));
+    m.payload[3] ^= 1;
+    report("dispatch", "server corrupt", timeOp(count, feed(server, clientMac), drain));
+
+    //  client side
+    frame(NOW_DT_HEARTBEAT, serverMac, clientMac, nullptr, 0);
+    report("dispatch", "client heartbeat", timeOp(count, feed(client, serverMac), drain));
+    frame(NOW_DT_DATA, serverMac, clientMac, payload, sizeof(payload));
+    report("dispatch", "client data", timeOp(count, feed(client, serverMac), drain));
+    frame(NOW_DT_DATA_ACK, serverMac, clientMac, &ack, sizeof(ack));
+    report("dispatch", "client data ack", timeOp(count, feed(client, serverMac), drain));
+    frame(NOW_DT_DATA, strangerMac, clientMac, payload, sizeof(payload));
+    report("dispatch", "client data unbound", timeOp(count, feed(client, strangerMac), drain));
+
+    unsigned long lastBind;
+    say("dispatch: server received %lu, still bound %d/1\n", net.server.received, net.boundClients(lastBind));
+}
+
+#pragma endregion
@@ -0,0 +1,1237 @@
+#include "Bench.h"
+#include <NowDebug.h>
+#include <NowLz.h>
+#include <algorithm>
+#include <math.h>
+
+static void printMetrics(const char *name, NowService *service)
+{
+    static NowMetricsSnapshot m;
+    service->metrics(m);
+    say("metrics: %s sent", name);
+    for (int i = 0; i < NOW_DT_COUNT; i++) say(" %u", m.sent[i]);
+    say(", received");
+    for (int i = 0; i < NOW_DT_COUNT; i++) say(" %u", m.received[i]);
+    say(", rejected %u, corrupted %u, unbound %u, advertisements %u, binds %u/%u, bind p50 %ums p99 %ums, hb rtt p50 %ums (%u), peers %d\n",
+        m.rejected, m.corrupted, m.droppedUnbound, m.advertisements, m.binds, m.unbinds, m.timeToBind.percentile(0.5f),
+        m.timeToBind.percentile(0.99f), m.heartbeatRtt.percentile(0.5f), m.heartbeatRtt.count, m.peerCount);
+}
+
+//  discovery convergence - every client starts advertising at once
+static void benchBind(int clientCount)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "%d", clientCount);
+    SimNetwork net(clientCount);
+    net.begin();
+    net.runUntilBound(10000);
+    unsigned long lastBind;
+    int bound = net.boundClients(lastBind);
+    NowMetricsSnapshot m;
+    net.server.service->metrics(m);
+    say("bind: %d/%d clients bound, last bind after %lums, p50 %ums, frames on air: %lu\n", bound, clientCount,
+        lastBind, m.timeToBind.percentile(0.5f), net.medium.stats.framesSent);
+    result("bind", name, "bound", bound, "clients");
+    result("bind", name, "last_bind", lastBind, "ms");
+    result("bind", name, "bind_p50", m.timeToBind.percentile(0.5f), "ms");
+    result("bind", name, "bind_p99", m.timeToBind.percentile(0.99f), "ms");
+    result("bind", name, "frames", net.medium.stats.framesSent, "frames");
+}
+
+//  ms from start until the given share of clients was bound
+static unsigned long bindPercentile(SimNetwork &net, unsigned long start, float p)
+{
+    std::vector<unsigned long> times;
+    for (SimNode &client : net.clients)
+    {
+        if (client.bound) times.push_back(client.boundAt - start);
+    }
+    if (times.empty()) return 0;
+    std::sort(times.begin(), times.end());
+    size_t rank = (size_t)(p * net.clients.size());
+    return times[(rank < times.size()) ? rank : times.size() - 1];
+}
+
+//  discovery on a contended channel, with the fixed 1s advertising the
+//  clients used to do and no solicit (legacy), or burst and backoff with
+//  jitter.
+//  "power up": every node comes up in the same ms after an outage.
+//  "restart": the clients have been looking for a while when the server
+//  comes up and solicits them.
+static void benchDiscovery(int clientCount, bool legacy, bool restart)
+{
+    char name[48];
+    snprintf(name, sizeof(name), "%s %s %d", restart ? "restart" : "power up", legacy ? "legacy" : "backoff", clientCount);
+    SimNetwork net(clientCount);
+    net.medium.config.contentionSlots = 16;
+    for (SimNode &client : net.clients)
+    {
+        if (legacy) static_cast<NowClient *>(client.service.get())->setAdvertising(1000, 1000, 1, 0);
+        net.begin(client);
+    }
+    if (restart) net.runFor(30500);
+    unsigned long start = net.medium.millis();
+    unsigned long collisionsBefore = net.medium.stats.framesCollided;
+    unsigned long framesBefore = net.medium.stats.framesSent;
+    if (legacy) static_cast<NowServer *>(net.server.service.get())->setSolicitWindow(0);
+    net.begin(net.server);
+    net.runUntilBound(30000);
+
+    unsigned long lastBind;
+    int bound = net.boundClients(lastBind);
+    unsigned long p50 = bindPercentile(net, start, 0.5f);
+    unsigned long p100 = bound ? lastBind - start : 0;
+    unsigned long collisions = net.medium.stats.framesCollided - collisionsBefore;
+    unsigned long frames = net.medium.stats.framesSent - framesBefore;
+    say("discovery: %s, %d/%d bound, p50 %lums, all %lums, frames on air %lu, collided %lu\n", name, bound,
+        clientCount, p50, p100, frames, collisions);
+    result("discovery", name, "bound", bound, "clients");
+    result("discovery", name, "bind_p50", p50, "ms");
+    result("discovery", name, "bind_all", p100, "ms");
+    result("discovery", name, "frames", frames, "frames");
+    result("discovery", name, "collided", collisions, "frames");
+}
+
+//  clients that don't know the server's channel sweep for it, or start on
+//  the channel cached from a previous run
+static void benchScan(int clientCount, uint8_t serverChannel, uint8_t cachedChannel)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "channel %d cached %d clients %d", serverChannel, cachedChannel, clientCount);
+    SimNetwork net(clientCount);
+    net.medium.config.contentionSlots = 16;
+    net.server.transport->setChannel(serverChannel);
+    for (SimNode &client : net.clients)
+    {
+        static_cast<NowClient *>(client.service.get())->setScanning(true, cachedChannel);
+    }
+    net.begin();
+    net.runUntilBound(30000);
+
+    unsigned long lastBind;
+    int bound = net.boundClients(lastBind);
+    uint32_t sweeps = 0;
+    NowMetricsSnapshot m;
+    for (SimNode &client : net.clients)
+    {
+        client.service->metrics(m);
+        sweeps += m.channelScans;
+    }
+    say("scan: %s, %d/%d bound, p50 %lums, all %lums, sweeps %u\n", name, bound, clientCount,
+        bindPercentile(net, 0, 0.5f), lastBind, sweeps);
+    result("scan", name, "bound", bound, "clients");
+    result("scan", name, "bind_p50", bindPercentile(net, 0, 0.5f), "ms");
+    result("scan", name, "bind_all", lastBind, "ms");
+    result("scan", name, "sweeps", sweeps, "sweeps");
+}
+
+//  the server follows its AP to another channel - the clients lose it,
+//  fail their heartbeats and sweep for it again
+static void benchScanMove(int clientCount, uint8_t from, uint8_t to)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "channel %d to %d clients %d", from, to, clientCount);
+    SimNetwork net(clientCount);
+    net.medium.config.contentionSlots = 16;
+    net.server.transport->setChannel(from);
+    for (SimNode &client : net.clients)
+    {
+        static_cast<NowClient *>(client.service.get())->setScanning(true, from);
+    }
+    net.begin();
+    net.runUntilBound(30000);
+    for (SimNode &client : net.clients) client.bound = false;
+    net.server.transport->setChannel(to);
+
+    //  from each client giving up on the server until it is bound again
+    std::vector<unsigned long> lostAt(clientCount, 0);
+    unsigned long start = net.medium.millis();
+    NowMetricsSnapshot m;
+    unsigned long lastBind = 0;
+    while ((net.boundClients(lastBind) < clientCount) && (net.medium.millis() - start < 300000))
+    {
+        net.runFor(10);
+        for (int i = 0; i < clientCount; i++)
+        {
+            if (lostAt[i]) continue;
+            net.clients[i].service->metrics(m);
+            if (m.unbinds) lostAt[i] = net.medium.millis();
+        }
+    }
+    unsigned long worst = 0;
+    for (int i = 0; i < clientCount; i++)
+    {
+        SimNode &client = net.clients[i];
+        if (client.bound && lostAt[i] && (client.boundAt - lostAt[i] > worst)) worst = client.boundAt - lostAt[i];
+    }
+    int bound = net.boundClients(lastBind);
+    say("scan: %s, %d/%d bound again %lums after the move, %lums after giving up\n", name, bound, clientCount,
+        lastBind - start, worst);
+    result("scan", name, "bound", bound, "clients");
+    result("scan", name, "rebind", lastBind - start, "ms");
+    result("scan", name, "rescan", worst, "ms");
+}
+
+//  steady state traffic once bound
+static void benchData(int clientCount)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "%d", clientCount);
+    SimNetwork net(clientCount);
+    net.begin();
+    net.runUntilBound(10000);
+    net.medium.stats = SimStats();
+
+    //  what a full send queue refuses is offered again as it drains
+    const char msg[] = "This is a test";
+    std::vector<int> backlog(clientCount, 0);
+    int waiting = 0;
+    auto offer = [&]() {
+        waiting = 0;
+        for (int c = 0; c < clientCount; c++)
+        {
+            while (backlog[c] && net.clients[c].service->sendData(reinterpret_cast<const uint8_t *>(msg), sizeof(msg) - 1)) backlog[c]--;
+            waiting += backlog[c];
+        }
+    };
+    for (int i = 0; i < 100; i++)
+    {
+        for (int &left : backlog) left++;
+        offer();
+        net.runFor(5);
+    }
+    for (int ms = 0; waiting && (ms < 10000); ms++)
+    {
+        offer();
+        net.runFor(1);
+    }
+    net.runFor(1000);
+    say("data: server received %lu/%d, frames on air: %lu, airtime: %lluus, rx overruns: %u\n",
+        net.server.received, 100 * clientCount, net.medium.stats.framesSent, net.medium.stats.airtimeUs,
+        net.server.service->rxOverruns());
+    result("data", name, "delivered", net.server.received / (100.0 * clientCount), "ratio");
+    result("data", name, "airtime", net.medium.stats.airtimeUs, "us");
+
+    //  fragmented messages, reordered by latency jitter
+    static uint8_t large[NOW_MAX_MESSAGE];
+    for (size_t i = 0; i < sizeof(large); i++) large[i] = (uint8_t)i;
+    unsigned long receivedBefore = net.server.received;
+    for (int i = 0; i < NOW_REASSEMBLY_SLOTS && i < clientCount; i++)
+    {
+        net.clients[i].service->sendData(large, sizeof(large));
+    }
+    net.runFor(1000);
+    say("fragments: server reassembled %lu/%d messages of %u bytes\n",
+        net.server.received - receivedBefore, NOW_REASSEMBLY_SLOTS, (unsigned)sizeof(large));
+    result("fragments", name, "delivered", (net.server.received - receivedBefore) / (double)NOW_REASSEMBLY_SLOTS, "ratio");
+    printMetrics("server", net.server.service.get());
+}
+
+//  a gateway talking to more clients than the driver holds peers
+static void benchPeers(int clientCount, int maxPeers)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "%d/%d", clientCount, maxPeers);
+    SimNetwork net(clientCount);
+    net.medium.config.maxPeers = maxPeers;
+    net.begin();
+    bool bound = net.runUntilBound(10000);
+    unsigned long lastBind;
+    int boundCount = net.boundClients(lastBind);
+    net.medium.stats = SimStats();
+
+    const char msg[] = "This is a test";
+    uint8_t mac[6];
+    for (int i = 0; i < 100; i++)
+    {
+        for (int c = 0; c < clientCount; c++)
+        {
+            SimNetwork::makeMac(mac, 0x02, c);
+            net.server.service->sendData(mac, reinterpret_cast<const uint8_t *>(msg), sizeof(msg) - 1);
+        }
+        //  a frame takes most of a ms on air
+        net.runFor(clientCount);
+    }
+    net.runFor(1000);
+    unsigned long received = 0;
+    for (SimNode &client : net.clients) received += client.received;
+    NowMetricsSnapshot m;
+    net.server.service->metrics(m);
+    double callsPerFrame = (double)net.medium.stats.peerCalls / net.medium.stats.framesSent;
+    say("peers %s: bound %d/%d%s, last bind %lums, clients received %lu/%d, driver peer calls %.3f/frame, registrations %u, evictions %u\n",
+        name, boundCount, clientCount, bound ? "" : " (timeout)", lastBind, received, 100 * clientCount,
+        callsPerFrame, m.peerRegistrations, m.peerEvictions);
+    result("peers", name, "bound", boundCount, "clients");
+    result("peers", name, "delivered", received / (100.0 * clientCount), "ratio");
+    result("peers", name, "driver_calls", callsPerFrame, "calls/frame");
+    result("peers", name, "evictions", m.peerEvictions, "count");
+}
+
+//  the server pushing one message to every bound client - a unicast per
+//  client, one group frame, or one group frame with acks and resends
+static void benchGroup(int clientCount, const char *how, float lossRate)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%s %d loss %.0f%%", how, clientCount, lossRate * 100);
+    SimNetwork net(clientCount);
+    net.medium.config.contentionSlots = 16;
+    net.begin();
+    net.runUntilBound(10000);
+    NowServer *server = static_cast<NowServer *>(net.server.service.get());
+    NowRecipients everyone;
+    server->boundClients(everyone);
+    net.medium.config.lossRate = lossRate;
+    net.medium.stats = SimStats();
+
+    const int rounds = 20;
+    const char msg[] = "Set point 21.5";
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(msg);
+    unsigned long receivedBefore = 0;
+    for (SimNode &client : net.clients) receivedBefore += client.received;
+    unsigned long delivered = 0, acked = 0, completion = 0;
+    for (int i = 0; i < rounds; i++)
+    {
+        unsigned long start = net.medium.millis();
+        bool done = false;
+        if (!strcmp(how, "unicast"))
+        {
+            uint8_t mac[6];
+            for (int c = 0; c < clientCount; c++)
+            {
+                SimNetwork::makeMac(mac, 0x02, c);
+                server->sendData(mac, data, sizeof(msg) - 1);
+            }
+        }
+        else if (!strcmp(how, "acked"))
+        {
+            server->sendGroup(everyone, data, sizeof(msg) - 1, [&](const NowRecipients &ok, const NowRecipients &missing) {
+                acked += ok.count();
+                done = true;
+            });
+        }
+        else server->sendGroup(everyone, data, sizeof(msg) - 1);
+        //  until every client has it, or the acks are settled
+        unsigned long expected = receivedBefore + (unsigned long)(i + 1) * clientCount;
+        for (int ms = 0; ms < 500; ms++)
+        {
+            unsigned long received = 0;
+            for (SimNode &client : net.clients) received += client.received;
+            delivered = received - receivedBefore;
+            if (!strcmp(how, "acked") ? done : (received >= expected)) break;
+            net.runFor(1);
+        }
+        completion += net.medium.millis() - start;
+        net.runFor(50);
+    }
+    unsigned long total = 0;
+    for (SimNode &client : net.clients) total += client.received;
+    delivered = total - receivedBefore;
+    say("group %s: clients received %lu/%d, acked %lu, frames on air %lu, collided %lu, airtime %lluus, completion %.1fms\n",
+        name, delivered, rounds * clientCount, acked, net.medium.stats.framesSent, net.medium.stats.framesCollided,
+        net.medium.stats.airtimeUs, (double)completion / rounds);
+    result("group", name, "delivered", delivered / (double)(rounds * clientCount), "ratio");
+    result("group", name, "frames", net.medium.stats.framesSent / (double)rounds, "frames/message");
+    result("group", name, "airtime", net.medium.stats.airtimeUs / (double)rounds, "us/message");
+    result("group", name, "completion", (double)completion / rounds, "ms");
+}
+
+//  a NOW_DT_GROUP frame from the server, handed straight to the client
+static void injectGroup(SimNode &client, uint16_t msgId, int bitmapLength)
+{
+    uint8_t serverMac[6];
+    SimNetwork::makeMac(serverMac, 0x01, 0);
+    const uint8_t broadcast[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+    NowGroupHeader header = {};
+    header.msgId = msgId;
+    header.bitmapLength = (uint8_t)bitmapLength;
+    const char msg[] = "Set point 21.5";
+    NowMsg m;
+    buildMsg(m, NOW_DT_GROUP, serverMac, broadcast, nullptr, 0);
+    memcpy(m.payload, &header, sizeof(header));
+    memset(m.payload + sizeof(header), 0xff, bitmapLength);
+    memcpy(m.payload + sizeof(header) + bitmapLength, msg, sizeof(msg) - 1);
+    m.length = (uint16_t)(sizeof(header) + bitmapLength + sizeof(msg) - 1);
+    sealMsg(m);
+    client.service->dataReceived(serverMac, reinterpret_cast<const uint8_t *>(&m), msgSize(m));
+}
+
+//  group frames as the client sees them: ids are the server's msgIds, a
+//  repeated id is a resend. A bitmap longer than this build's
+//  NowRecipients is what a server with a larger NOW_MAX_CLIENTS sends.
+static void benchGroupFrames(const char *name, const std::vector<uint16_t> &ids, int bitmapLength, unsigned long expected)
+{
+    SimNetwork net(1);
+    net.begin();
+    net.runUntilBound(5000);
+    SimNode &client = net.clients[0];
+    unsigned long before = client.received;
+    for (uint16_t id : ids)
+    {
+        injectGroup(client, id, bitmapLength);
+        net.runFor(10);
+    }
+    unsigned long delivered = client.received - before;
+    say("group %s: %d frames, %d byte bitmap, client received %lu/%lu\n", name, (int)ids.size(), bitmapLength,
+        delivered, expected);
+    result("group", name, "delivered", delivered, "messages");
+    if (delivered != expected) exit(1);
+}
+
+//  every client sends a reading every period ms, at a random point of the
+//  period or all at once - contending for the channel, or each in its slot
+//  of a TDMA schedule
+static void benchTdma(int clientCount, unsigned long period, bool together, bool tdma)
+{
+    char name[48];
+    snprintf(name, sizeof(name), "%s %d every %lums%s", tdma ? "tdma" : "csma", clientCount, period,
+             together ? " together" : "");
+    SimNetwork net(clientCount);
+    net.medium.config.contentionSlots = 16;
+    NowServer *server = static_cast<NowServer *>(net.server.service.get());
+    if (tdma) server->setTdma();
+    net.begin();
+    net.runUntilBound(30000);
+    unsigned long lastBind;
+    int bound = net.boundClients(lastBind);
+    net.runFor(1000);
+
+    std::vector<unsigned long> delays;
+    server->setDataViewReceived([&](const NowDataView &view) {
+        uint32_t sentAt;
+        if (view.length >= 4)
+        {
+            memcpy(&sentAt, view.data, 4);
+            delays.push_back(net.medium.millis() - sentAt);
+        }
+        server->release(view);
+    });
+    SimStats before = net.medium.stats;
+    uint8_t reading[32] = {0};
+    unsigned long start = net.medium.millis();
+    unsigned long offered = 0, refused = 0;
+    const unsigned long duration = 10000;
+    std::vector<unsigned long> phases(clientCount, 0);
+    uint32_t seed = 7;
+    for (unsigned long &phase : phases)
+    {
+        seed = seed * 1103515245 + 12345;
+        if (!together) phase = (seed >> 8) % period;
+    }
+    while (net.medium.millis() - start < duration)
+    {
+        unsigned long now = net.medium.millis();
+        for (int i = 0; i < clientCount; i++)
+        {
+            if ((now + phases[i]) % period) continue;
+            uint32_t sentAt = now;
+            memcpy(reading, &sentAt, 4);
+            offered++;
+            if (!net.clients[i].service->sendData(reading, sizeof(reading))) refused++;
+        }
+        net.runFor(1);
+    }
+    size_t inTime = delays.size();
+    net.runFor(1000);
+
+    unsigned long sent = net.medium.stats.framesSent - before.framesSent;
+    unsigned long collided = net.medium.stats.framesCollided - before.framesCollided;
+    std::sort(delays.begin(), delays.end());
+    unsigned long p50 = delays.empty() ? 0 : delays[delays.size() / 2];
+    unsigned long p99 = delays.empty() ? 0 : delays[delays.size() * 99 / 100];
+    double goodput = inTime * sizeof(reading) / (double)duration;
+    double busy = (net.medium.stats.airtimeUs - before.airtimeUs) / (duration * 10.0);
+    say("tdma: %s, %d/%d bound after %lums, delivered %zu/%lu (%lu refused), goodput %.2f kB/s, "
+        "collided %lu/%lu frames (%.1f%%), airtime %.1f%%, delay p50 %lums p99 %lums\n",
+        name, bound, clientCount, lastBind, delays.size(), offered, refused, goodput, collided, sent,
+        sent ? 100.0 * collided / sent : 0.0, busy, p50, p99);
+    result("tdma", name, "goodput", goodput, "kB/s");
+    result("tdma", name, "delivered", offered ? (double)delays.size() / offered : 0, "ratio");
+    result("tdma", name, "collision_rate", sent ? (double)collided / sent : 0, "ratio");
+    result("tdma", name, "delay_p99", p99, "ms");
+}
+
+//  clients in rings 45m apart around a server with 50m range - only the
+//  first ring hears the server, every ring relays for the next
+static void benchRelay(int perRing, int rings, bool relay)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%s %dx%d", relay ? "relay" : "direct", rings, perRing);
+    int clientCount = perRing * rings;
+    SimNetwork net(clientCount);
+    net.medium.config.contentionSlots = 16;
+    net.medium.config.range = 50.0f;
+    for (int i = 0; i < clientCount; i++)
+    {
+        int ring = i / perRing;
+        net.clients[i].transport->setPosition(45.0f * ring + 5.0f + 30.0f * (i % perRing) / perRing, 0.0f);
+        static_cast<NowClient *>(net.clients[i].service.get())->setRelay(relay);
+    }
+    net.begin();
+    net.runUntilBound(30000);
+    unsigned long lastBind;
+    int bound = net.boundClients(lastBind);
+    say("relay: %s, %d/%d bound, last after %lums, per ring", name, bound, clientCount, lastBind);
+    for (int ring = 0; ring < rings; ring++)
+    {
+        int ringBound = 0;
+        for (int i = ring * perRing; i < (ring + 1) * perRing; i++) ringBound += net.clients[i].bound;
+        say(" %d", ringBound);
+    }
+    say("\n");
+    result("relay", name, "bound", bound, "clients");
+    result("relay", name, "last_bind", lastBind, "ms");
+
+    //  both ways, every bound client
+    net.medium.stats = SimStats();
+    const char msg[] = "This is a test";
+    uint8_t mac[6];
+    int sent = 0;
+    for (int round = 0; round < 20; round++)
+    {
+        for (int i = 0; i < clientCount; i++)
+        {
+            if (!net.clients[i].bound) continue;
+            net.clients[i].service->sendData(reinterpret_cast<const uint8_t *>(msg), sizeof(msg) - 1);
+            SimNetwork::makeMac(mac, 0x02, i);
+            net.server.service->sendData(mac, reinterpret_cast<const uint8_t *>(msg), sizeof(msg) - 1);
+            sent++;
+        }
+        net.runFor(5 * clientCount);
+    }
+    net.runFor(1000);
+    unsigned long down = 0;
+    for (SimNode &client : net.clients) down += client.received;
+    unsigned long relayed = 0, duplicates = 0;
+    NowMetricsSnapshot m;
+    for (SimNode &client : net.clients)
+    {
+        client.service->metrics(m);
+        relayed += m.relayed;
+        duplicates += m.relayDuplicates;
+    }
+    say("relay: %s, up %lu/%d, down %lu/%d, frames on air %lu, relayed %lu, duplicates dropped %lu\n", name,
+        net.server.received, sent, down, sent, net.medium.stats.framesSent, relayed, duplicates);
+    result("relay", name, "up", sent ? net.server.received / (double)sent : 0, "ratio");
+    result("relay", name, "down", sent ? down / (double)sent : 0, "ratio");
+    result("relay", name, "frames_on_air", net.medium.stats.framesSent, "frames");
+}
+
+//  a client pushes bulk data as fast as it can with a reading every 50ms,
+//  while a second client tries to bind - sent straight to the driver, or
+//  as bulk and real-time classes
+static void benchPriority(bool classes)
+{
+    const char *name = classes ? "classes" : "direct";
+    SimNetwork net(2);
+    for (SimNode *node : net.nodes) node->service->setLiveness(1000);
+    NowService *streamer = net.clients[0].service.get();
+    std::vector<unsigned long> readingDelays;
+    unsigned long bulkReceived = 0;
+    net.begin(net.server);
+    net.begin(net.clients[0]);
+    net.runUntilBound(5000);
+    NowService *server = net.server.service.get();
+    server->setDataViewReceived([&](const NowDataView &view) {
+        uint32_t sentAt;
+        if ((view.length >= 5) && (view.data[0] == 1))
+        {
+            memcpy(&sentAt, view.data + 1, 4);
+            readingDelays.push_back(net.medium.millis() - sentAt);
+        }
+        else bulkReceived++;
+        server->release(view);
+    });
+
+    uint8_t bulk[200];
+    memset(bulk, 0, sizeof(bulk));
+    uint8_t reading[16] = {1};
+    unsigned long start = net.medium.millis();
+    unsigned long offered = 0, refused = 0;
+    const unsigned long duration = 5000;
+    bool lateBegun = false;
+    while (net.medium.millis() - start < duration)
+    {
+        unsigned long now = net.medium.millis();
+        if (!lateBegun && (now - start >= 1000))
+        {
+            net.begin(net.clients[1]);
+            lateBegun = true;
+        }
+        //  twice what the channel carries
+        offered++;
+        if (!streamer->sendData(bulk, sizeof(bulk), classes ? NOW_TRAFFIC_BULK : NOW_TRAFFIC_CONTROL)) refused++;
+        if ((now - start) % 50 == 0)
+        {
+            uint32_t sentAt = now;
+            memcpy(reading + 1, &sentAt, 4);
+            streamer->sendData(reading, sizeof(reading), classes ? NOW_TRAFFIC_REALTIME : NOW_TRAFFIC_CONTROL);
+        }
+        net.runFor(1);
+    }
+    unsigned long bulkInTime = bulkReceived;
+    net.runFor(2000);
+
+    std::sort(readingDelays.begin(), readingDelays.end());
+    unsigned long p50 = readingDelays.empty() ? 0 : readingDelays[readingDelays.size() / 2];
+    unsigned long p99 = readingDelays.empty() ? 0 : readingDelays[readingDelays.size() * 99 / 100];
+    NowMetricsSnapshot m;
+    streamer->metrics(m);
+    unsigned long bindTime = net.clients[1].bound ? net.clients[1].boundAt - start - 1000 : 0;
+    double rate = bulkInTime * sizeof(bulk) / (double)duration;
+    say("priority: %s, bulk %.1f kB/s (%lu/%lu refused), readings %zu/%lu p50 %lums p99 %lums, "
+        "streamer unbinds %u probes %u, late bind %s %lums\n",
+        name, rate, refused, offered, readingDelays.size(), duration / 50, p50, p99, m.unbinds, m.probes,
+        net.clients[1].bound ? "after" : "failed", bindTime);
+    result("priority", name, "bulk", rate, "kB/s");
+    result("priority", name, "reading_p99", p99, "ms");
+    result("priority", name, "late_bind", bindTime, "ms");
+}
+
+static void benchReliable(float lossRate)
+{
+    SimNetwork net(1);
+    net.begin();
+    net.runFor(5000);
+    net.medium.config.lossRate = lossRate;
+    net.medium.config.duplicateRate = 0.05f;
+    net.clients[0].service->setReliable(true);
+
+    const int count = 2000;
+    uint8_t msg[200] = {0};
+    unsigned long start = net.medium.millis();
+    int sent = 0;
+    while ((net.server.received < (unsigned long)count) && (net.medium.millis() - start < 60000))
+    {
+        //  push as much as the window takes, then let the medium run
+        while ((sent < count) && net.clients[0].service->sendData(msg, sizeof(msg))) sent++;
+        net.runFor(1);
+    }
+    unsigned long elapsed = net.medium.millis() - start;
+    say("reliable: loss %.0f%%, delivered %lu/%d in %lums (%.1f kB/s), frames on air: %lu\n",
+        lossRate * 100, net.server.received, count, elapsed,
+        elapsed ? net.server.receivedBytes / (float)elapsed : 0.0f, net.medium.stats.framesSent);
+    char name[16];
+    snprintf(name, sizeof(name), "loss %.0f%%", lossRate * 100);
+    result("reliable", name, "delivered", net.server.received / (double)count, "ratio");
+    result("reliable", name, "throughput", elapsed ? net.server.receivedBytes / (double)elapsed : 0.0, "kB/s");
+    result("reliable", name, "frames", net.medium.stats.framesSent, "frames");
+}
+
+static void benchAsync(bool reliable)
+{
+    SimNetwork net(1);
+    net.begin();
+    net.runFor(5000);
+    net.medium.config.lossRate = 0.05f;
+    NowService *client = net.clients[0].service.get();
+    client->setReliable(reliable);
+
+    const int count = 2000;
+    uint8_t msg[200] = {0};
+    int queued = 0;
+    int completed = 0;
+    int failed = 0;
+    unsigned long start = net.medium.millis();
+    while ((completed < count) && (net.medium.millis() - start < 60000))
+    {
+        //  the producer never blocks, it just stops when the queue is full
+        while ((queued < count) && client->sendDataAsync(msg, sizeof(msg), [&](bool ok) { completed++; if (!ok) failed++; })) queued++;
+        net.runFor(1);
+    }
+    net.runFor(1000);
+    unsigned long elapsed = net.medium.millis() - start;
+    say("async: reliable %s, completed %d/%d (%d failed), server received %lu in %lums, frames on air: %lu\n",
+        reliable ? "on" : "off", completed, count, failed, net.server.received, elapsed, net.medium.stats.framesSent);
+    const char *name = reliable ? "reliable" : "unreliable";
+    result("async", name, "completed", completed / (double)count, "ratio");
+    result("async", name, "failed", failed, "messages");
+    result("async", name, "elapsed", elapsed, "ms");
+}
+
+//  small readings offered faster than one frame each can carry them
+static void benchBatching(unsigned long delay)
+{
+    SimNetwork net(1);
+    net.begin();
+    net.runFor(5000);
+    NowService *client = net.clients[0].service.get();
+    client->setBatching(delay);
+    unsigned long framesBefore = net.medium.stats.framesSent;
+
+    const int count = 5000;
+    uint8_t reading[16] = {0};
+    unsigned long start = net.medium.millis();
+    int sent = 0;
+    while ((net.server.received < (unsigned long)count) && (net.medium.millis() - start < 60000))
+    {
+        for (int i = 0; (i < 10) && (sent < count); i++)
+        {
+            reading[0] = (uint8_t)sent;
+            if (client->sendData(reading, sizeof(reading))) sent++;
+        }
+        net.runFor(1);
+    }
+    unsigned long elapsed = net.medium.millis() - start;
+    say("batching: delay %lums, delivered %lu/%d in %lums (%.0f msg/s), frames on air: %lu\n",
+        delay, net.server.received, count, elapsed, elapsed ? net.server.received * 1000.0f / elapsed : 0.0f,
+        net.medium.stats.framesSent - framesBefore);
+    char name[16];
+    snprintf(name, sizeof(name), "delay %lu", delay);
+    result("batching", name, "throughput", elapsed ? net.server.received * 1000.0 / elapsed : 0.0, "msg/s");
+    result("batching", name, "frames", net.medium.stats.framesSent - framesBefore, "frames");
+}
+
+//  a message too large to batch must not overtake the batch before it
+static void benchBatchOrder()
+{
+    SimNetwork net(1);
+    std::vector<uint8_t> order;
+    for (SimNode &client : net.clients) net.begin(client);
+    net.server.begun = net.server.service->begin([](String) {}, [&order](uint8_t *data, int length) {
+        if (length > 0) order.push_back(data[0]);
+    });
+    net.runUntilBound(5000);
+    NowService *client = net.clients[0].service.get();
+    client->setBatching(NOW_BATCH_DELAY);
+
+    static uint8_t large[NOW_MAX_BATCHED + 1];
+    uint8_t small[8] = {1};
+    large[0] = 2;
+    bool sent = client->sendData(small, sizeof(small)) && client->sendData(large, sizeof(large));
+    net.runFor(1000);
+    bool ordered = sent && (order.size() == 2) && (order[0] == 1) && (order[1] == 2);
+    say("batching: small then %d byte message, delivered %d in %s\n", (int)sizeof(large), (int)order.size(),
+        ordered ? "order" : "the WRONG order");
+    result("batching", "order", "ordered", ordered, "bool");
+    if (!ordered) exit(1);
+}
+
+//  telemetry as the nodes send it
+static int makeJson(char *out, int size, int i)
+{
+    return snprintf(out, size,
+                    "{\"id\":\"node-%02d\",\"seq\":%d,\"temp\":%d.%d,\"hum\":%d.%d,\"press\":%d,"
+                    "\"bat\":%d,\"rssi\":-%d,\"status\":\"ok\",\"uptime\":%d,\"readings\":[%d,%d,%d,%d,%d,%d]}",
+                    i % 30, i, 20 + i % 5, i % 10, 40 + i % 20, i % 10, 1000 + i % 30, 3300 - i % 200, 40 + i % 50,
+                    i * 7, i % 100, (i + 3) % 100, (i + 9) % 100, (i + 13) % 100, (i + 17) % 100, (i + 19) % 100);
+}
+
+static int makeJsonBatch(char *out, int size, int i)
+{
+    int n = 0;
+    for (int k = 0; (k < 3) && (n < size - 1); k++) n += makeJson(out + n, size - n, i + k);
+    return (n < size) ? n : size - 1;
+}
+
+static int makeCsv(char *out, int size, int i)
+{
+    int n = 0;
+    for (int row = 0; (row < 12) && (n < size); row++)
+    {
+        n += snprintf(out + n, size - n, "%d,node-%02d,%d.%d,%d.%d,%d\n", i * 12 + row, i % 30, 20 + row % 5, row,
+                      40 + row % 20, (i + row) % 10, 1000 + row);
+    }
+    return (n < size) ? n : size - 1;
+}
+
+//  compression ratio and codec cost on representative payloads
+static void benchCompressionCodec(const char *name, int (*make)(char *, int, int))
+{
+    static NowLz lz;
+    char text[NOW_COMPRESS_MAX];
+    uint8_t packed[NOW_COMPRESS_MAX];
+    uint8_t unpacked[NOW_COMPRESS_MAX];
+    unsigned long raw = 0, compressed = 0;
+    uint64_t compressCycles = 0, decompressCycles = 0;
+    int failed = 0;
+    const int count = 2000;
+    for (int i = 0; i < count; i++)
+    {
+        int length = make(text, sizeof(text), i);
+        uint64_t start = cycles();
+        int packedLength = lz.compress(reinterpret_cast<uint8_t *>(text), length, packed, sizeof(packed));
+        uint64_t middle = cycles();
+        int unpackedLength = NowLz::decompress(packed, packedLength, unpacked, sizeof(unpacked));
+        uint64_t end = cycles();
+        if ((unpackedLength != length) || memcmp(unpacked, text, length)) failed++;
+        raw += length;
+        compressed += packedLength;
+        compressCycles += middle - start;
+        decompressCycles += end - middle;
+    }
+    say("compression: %s %lu bytes avg, ratio %.2f, compress %.1f cycles/byte, decompress %.1f cycles/byte, %d failed\n",
+        name, raw / count, (float)raw / compressed, (float)compressCycles / raw, (float)decompressCycles / raw, failed);
+    result("codec", name, "ratio", (double)raw / compressed, "ratio");
+    result("codec", name, "compress", (double)compressCycles / raw, "cycles/byte");
+    result("codec", name, "decompress", (double)decompressCycles / raw, "cycles/byte");
+    result("codec", name, "failed", failed, "messages");
+}
+
+//  JSON messages a little too big for one frame
+static void benchCompression(bool enabled)
+{
+    SimNetwork net(1);
+    net.begin();
+    net.runFor(5000);
+    NowService *client = net.clients[0].service.get();
+    client->setCompression(enabled);
+    unsigned long framesBefore = net.medium.stats.framesSent;
+    unsigned long long airtimeBefore = net.medium.stats.airtimeUs;
+
+    const int count = 500;
+    char text[NOW_COMPRESS_MAX];
+    unsigned long bytes = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int length = makeJson(text, sizeof(text), i);
+        length += makeJson(text + length, sizeof(text) - length, i + 1);
+        bytes += length;
+        client->sendData(reinterpret_cast<uint8_t *>(text), length);
+        net.runFor(5);
+    }
+    net.runFor(1000);
+    say("compression: %s, delivered %lu/%d messages of %lu bytes avg, frames on air: %lu, airtime: %lluus\n",
+        enabled ? "on" : "off", net.server.received, count, bytes / count, net.medium.stats.framesSent - framesBefore,
+        net.medium.stats.airtimeUs - airtimeBefore);
+    const char *name = enabled ? "on" : "off";
+    result("compression", name, "delivered", net.server.received / (double)count, "ratio");
+    result("compression", name, "frames", net.medium.stats.framesSent - framesBefore, "frames");
+    result("compression", name, "airtime", net.medium.stats.airtimeUs - airtimeBefore, "us");
+}
+
+//  readings published on a few topics, the server subscribes to some
+static void benchTopics(int clientCount)
+{
+    SimNetwork net(clientCount);
+    net.begin();
+    net.runFor(5000);
+    NowService *server = net.server.service.get();
+    unsigned long perTopic[4] = {0};
+    unsigned long wrongTopic = 0;
+    for (uint8_t topic = 0; topic < 3; topic++)
+    {
+        server->subscribe(topic, [&, topic](const NowDataView &view) {
+            perTopic[topic]++;
+            if (view.data[0] != topic) wrongTopic++;
+            server->release(view);
+        });
+    }
+    //  topic 3 has no subscriber, it ends up with the data callback
+    unsigned long receivedBefore = net.server.received;
+
+    const int rounds = 100;
+    for (int i = 0; i < rounds; i++)
+    {
+        for (SimNode &client : net.clients)
+        {
+            uint8_t topic = (uint8_t)(i % 4);
+            uint8_t reading[12] = {topic};
+            client.service->publish(topic, reading, sizeof(reading));
+        }
+        net.runFor(5);
+    }
+    net.runFor(1000);
+    say("topics: %lu/%lu/%lu to subscribers, %lu unsubscribed to the data callback, %lu misrouted\n",
+        perTopic[0], perTopic[1], perTopic[2], net.server.received - receivedBefore, wrongTopic);
+    char name[16];
+    snprintf(name, sizeof(name), "%d", clientCount);
+    result("topics", name, "subscribed", perTopic[0] + perTopic[1] + perTopic[2], "messages");
+    result("topics", name, "misrouted", wrongTopic, "messages");
+}
+
+//  worker wakeups on a quiet network - heartbeats are the only traffic
+static void benchIdle(int clientCount, unsigned long ms)
+{
+    SimNetwork net(clientCount);
+    net.begin();
+    net.runFor(5000);
+    for (SimNode *node : net.nodes) node->steps = 0;
+    net.runFor(ms);
+    unsigned long lastBind;
+    int bound = net.boundClients(lastBind);
+    say("idle: %lus, %d/%d clients bound, server wakeups %lu, client wakeups %lu (1s polling: %lu)\n",
+        ms / 1000, bound, clientCount, net.server.steps, net.clients[0].steps, ms / 1000);
+    char name[16];
+    snprintf(name, sizeof(name), "%d", clientCount);
+    result("idle", name, "server_wakeups", net.server.steps, "wakeups");
+    result("idle", name, "client_wakeups", net.clients[0].steps, "wakeups");
+    printMetrics("client", net.clients[0].service.get());
+}
+
+//  how fast a dead peer is noticed, and what staying alive costs on air -
+//  a client stops answering, then the server goes away
+static void benchLiveness(int clientCount, unsigned long heartbeatInterval, float phi, unsigned long dataEvery)
+{
+    char name[48];
+    snprintf(name, sizeof(name), "hb %lus phi %g data %lums", heartbeatInterval / 1000, phi, dataEvery);
+    SimNetwork net(clientCount);
+    for (SimNode *node : net.nodes) node->service->setLiveness(heartbeatInterval, phi);
+    net.begin();
+    net.runUntilBound(10000);
+    NowServer *server = static_cast<NowServer *>(net.server.service.get());
+
+    const char msg[] = "reading";
+    unsigned long lastSent = 0;
+    auto run = [&](unsigned long ms) {
+        for (unsigned long elapsed = 0; elapsed < ms; elapsed += 10)
+        {
+            unsigned long now = net.medium.millis();
+            if (dataEvery && (now - lastSent >= dataEvery))
+            {
+                lastSent = now;
+                for (SimNode &client : net.clients)
+                {
+                    if (client.begun) client.service->sendData(reinterpret_cast<const uint8_t *>(msg), sizeof(msg) - 1);
+                }
+            }
+            net.runFor(10);
+        }
+    };
+
+    //  what keeping the links alive costs once bound
+    static NowMetricsSnapshot m;
+    auto heartbeats = [&]() {
+        uint32_t total = 0;
+        for (SimNode *node : net.nodes)
+        {
+            node->service->metrics(m);
+            total += m.sent[NOW_DT_HEARTBEAT];
+        }
+        return total;
+    };
+    const unsigned long window = 600000;
+    uint32_t heartbeatsBefore = heartbeats();
+    run(window);
+    double clientMinutes = clientCount * (window / 60000.0);
+    double perMinute = (heartbeats() - heartbeatsBefore) / clientMinutes;
+    double airtime = perMinute * net.medium.airtime(sizeof(NowMsg) - NOW_MAX_PAYLOAD + sizeof(NowClockSync));
+
+    //  a client goes silent, the server has to notice
+    SimNode &lost = net.clients[0];
+    lost.begun = false;
+    lost.transport->setChannel(14);
+    unsigned long start = net.medium.millis();
+    while ((server->clientCount() == clientCount) && (net.medium.millis() - start < 10 * heartbeatInterval)) run(10);
+    unsigned long clientDetect = net.medium.millis() - start;
+
+    //  then the server, every remaining client has to notice
+    net.server.begun = false;
+    net.server.transport->setChannel(14);
+    std::vector<uint32_t> unbinds(clientCount, 0);
+    for (int i = 1; i < clientCount; i++)
+    {
+        net.clients[i].service->metrics(m);
+        unbinds[i] = m.unbinds;
+    }
+    start = net.medium.millis();
+    unsigned long serverDetect = 0;
+    int noticed = 0;
+    while ((noticed < clientCount - 1) && (net.medium.millis() - start < 10 * heartbeatInterval))
+    {
+        run(10);
+        noticed = 0;
+        for (int i = 1; i < clientCount; i++)
+        {
+            net.clients[i].service->metrics(m);
+            if (m.unbinds > unbinds[i]) noticed++;
+        }
+        serverDetect = net.medium.millis() - start;
+    }
+    uint32_t probes = 0;
+    for (SimNode *node : net.nodes)
+    {
+        node->service->metrics(m);
+        probes += m.probes;
+    }
+    say("liveness: %s, %.2f heartbeats/client-minute (%.0fus air), dead client noticed after %lums, "
+        "dead server by %d/%d after %lums, %u probes\n",
+        name, perMinute, airtime, clientDetect, noticed, clientCount - 1, serverDetect, probes);
+    result("liveness", name, "heartbeats", perMinute, "frames/client-minute");
+    result("liveness", name, "client_detect", clientDetect, "ms");
+    result("liveness", name, "server_detect", serverDetect, "ms");
+    result("liveness", name, "probes", probes, "frames");
+}
+
+//  clients with clocks off by up to a second and 50 ppm sync to the
+//  server over heartbeats, then time their readings on its clock
+static void benchClock(int clientCount, unsigned long syncInterval, unsigned long contentionSlots)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%d every %lums%s", clientCount, syncInterval, contentionSlots ? " busy" : "");
+    SimNetwork net(clientCount);
+    net.medium.config.contentionSlots = contentionSlots;
+    for (int i = 0; i < clientCount; i++)
+    {
+        //  deterministic spread of offsets and drifts
+        int64_t offset = ((int64_t)(i * 7919 % 2001) - 1000) * 1000;
+        float drift = (float)(i * 37 % 101) - 50.0f;
+        net.clients[i].transport->setClock(offset, drift);
+        static_cast<NowClient *>(net.clients[i].service.get())->setClockSync(syncInterval);
+    }
+    NowService *server = net.server.service.get();
+    //  readings carry the medium's µs when sent, the arrival is only known
+    //  to the ms - half a ms in, on average
+    double latencySum = 0, trueLatencySum = 0;
+    unsigned long latencyCount = 0, unsynced = 0;
+    server->setDataViewReceived([&](const NowDataView &view) {
+        if (view.latency < 0) unsynced++;
+        else if (view.length == sizeof(uint64_t))
+        {
+            uint64_t sentAt;
+            memcpy(&sentAt, view.data, sizeof(sentAt));
+            latencySum += view.latency;
+            trueLatencySum += (double)view.timestamp * 1000 + 500 - (double)sentAt;
+            latencyCount++;
+        }
+        server->release(view);
+    });
+    net.begin();
+    net.runUntilBound(10000);
+    //  converge, then measure while clients report every 100ms
+    net.runFor(4 * syncInterval);
+    std::vector<double> errors;
+    unsigned long heartbeatsBefore = 0;
+    NowMetricsSnapshot m;
+    for (SimNode &client : net.clients)
+    {
+        client.service->metrics(m);
+        heartbeatsBefore += m.sent[NOW_DT_HEARTBEAT];
+    }
+    const unsigned long measureMs = 30000;
+    for (unsigned long t = 0; t < measureMs; t += 100)
+    {
+        uint32_t truth = (uint32_t)net.server.transport->micros();
+        for (SimNode &client : net.clients)
+        {
+            errors.push_back(fabs((double)(int32_t)(client.service->networkMicros() - truth)));
+            uint64_t reading = net.medium.micros();
+            client.service->sendData(reinterpret_cast<const uint8_t *>(&reading), sizeof(reading));
+        }
+        net.runFor(100);
+    }
+    std::sort(errors.begin(), errors.end());
+    double driftError = 0;
+    unsigned long heartbeats = 0;
+    for (int i = 0; i < clientCount; i++)
+    {
+        net.clients[i].service->metrics(m);
+        heartbeats += m.sent[NOW_DT_HEARTBEAT];
+        float drift = (float)(i * 37 % 101) - 50.0f;
+        //  a fast clock falls behind the server by its drift
+        driftError = std::max(driftError, (double)fabs(m.clockDrift + drift));
+    }
+    double p50 = errors[errors.size() / 2], p99 = errors[errors.size() * 99 / 100], worst = errors.back();
+    server->metrics(m);
+    double latency = latencyCount ? latencySum / latencyCount : 0.0;
+    double trueLatency = latencyCount ? trueLatencySum / latencyCount : 0.0;
+    say("clock %s: error p50 %.0fus p99 %.0fus max %.0fus, drift error max %.2fppm, latency mean %.0fus (true %.0fus, %lu frames, %lu unsynced), sync heartbeats %.1f/client/min\n",
+        name, p50, p99, worst, driftError, latency, trueLatency, latencyCount, unsynced,
+        (heartbeats - heartbeatsBefore) * 60000.0 / measureMs / clientCount);
+    result("clock", name, "error_p50", p50, "us");
+    result("clock", name, "error_p99", p99, "us");
+    result("clock", name, "drift_error", driftError, "ppm");
+    result("clock", name, "latency", latency, "us");
+    result("clock", name, "latency_error", latency - trueLatency, "us");
+}
+
+//  the server keeps received views for a while before releasing them, as
+//  an application handing them to another task would
+static void benchLeases(int clientCount, unsigned long holdMs)
+{
+    SimNetwork net(clientCount);
+    net.begin();
+    net.runFor(5000);
+
+    NowService *server = net.server.service.get();
+    std::vector<NowDataView> held;
+    unsigned long viewed = 0;
+    unsigned long checksum = 0;
+    server->setDataViewReceived([&](const NowDataView &view) {
+        viewed++;
+        checksum += view.data[view.length - 1];
+        held.push_back(view);
+    });
+
+    const char msg[] = "This is a test";
+    static uint8_t large[2000];
+    for (size_t i = 0; i < sizeof(large); i++) large[i] = (uint8_t)i;
+    unsigned long releaseAt = net.medium.millis() + holdMs;
+    int count = 0;
+    //  messages a full send queue refused, offered again every ms
+    std::vector<int> small(clientCount, 0), big(clientCount, 0);
+    for (int ms = 0; ms < 2000; ms++)
+    {
+        if ((ms % 5 == 0) && (ms < 250))
+        {
+            for (int &left : small) left++;
+            big[(ms / 5) % clientCount]++;
+            count += clientCount + 1;
+        }
+        for (int c = 0; c < clientCount; c++)
+        {
+            NowService *client = net.clients[c].service.get();
+            while (small[c] && client->sendData(reinterpret_cast<const uint8_t *>(msg), sizeof(msg) - 1)) small[c]--;
+            while (big[c] && client->sendData(large, sizeof(large))) big[c]--;
+        }
+        net.runFor(1);
+        if (net.medium.millis() < releaseAt) continue;
+        for (const NowDataView &view : held) server->release(view);
+        held.clear();
+        releaseAt = net.medium.millis() + holdMs;
+    }
+    say("leases: held %lums, server viewed %lu/%d, checksum %lu, rx overruns: %u\n",
+        holdMs, viewed, count, checksum, server->rxOverruns());
+    char name[16];
+    snprintf(name, sizeof(name), "hold %lu", holdMs);
+    result("leases", name, "viewed", viewed / (double)count, "ratio");
+    result("leases", name, "overruns", server->rxOverruns(), "frames");
+}
+
+//  cost of a binary log record, and what a bind looks like in the log
+static void benchLog()
+{
+#if NOW_LOG_RING > 0
+    NowLogRecord records[NOW_LOG_RING];
+    nowLogRead(records, NOW_LOG_RING);
+    const int count = 1000000;
+    unsigned long start = micros();
+    for (int i = 0; i < count; i++) nowLog(NOW_LOG_RECEIVED, i, NOW_DT_DATA, 40);
+    unsigned long elapsed = micros() - start;
+    nowLogRead(records, NOW_LOG_RING);
+    say("log: %.1fns per record, ring of %d\n", elapsed * 1000.0 / count, NOW_LOG_RING);
+    result("log", "record", "time", elapsed * 1000.0 / count, "ns");
+
+    SimNetwork net(1);
+    net.begin();
+    net.runFor(100);
+    int kept = nowLogRead(records, NOW_LOG_RING);
+    say("log: %d records for one bind, first %s\n", kept, kept ? nowLogFormat(records[0]).c_str() : "-");
+#else
+    say("log: binary log compiled out\n");
+#endif
+}
+
+//  program [--json] [--tag release] [bench...]
+int main(int argc, char **argv)
+{
+    benchBegin(argc, argv);
+    if (benchSelected("messages")) benchMessages();
+    if (benchSelected("helpers")) benchHelpers();
+    if (benchSelected("dispatch")) benchDispatch();
+    if (benchSelected("bind"))
+    {
+        benchBind(1);
+        benchBind(10);
+        benchBind(30);
+    }
+    if (benchSelected("discovery"))
+    {
+        for (bool restart : {false, true})
+        {
+            for (bool legacy : {true, false})
+            {
+                benchDiscovery(1, legacy, restart);
+                benchDiscovery(30, legacy, restart);
+            }
+        }
+    }
+    if (benchSelected("scan"))
+    {
+        benchScan(1, 1, 0);
+        benchScan(1, 6, 0);
+        benchScan(1, 13, 0);
+        benchScan(10, 13, 0);
+        benchScan(10, 13, 13);
+        benchScanMove(10, 6, 11);
+    }
+    if (benchSelected("data")) benchData(20);
+    if (benchSelected("relay"))
+    {
+        benchRelay(5, 3, false);
+        benchRelay(5, 3, true);
+        benchRelay(10, 3, true);
+    }
+    if (benchSelected("group"))
+    {
+        for (float loss : {0.0f, 0.1f})
+        {
+            benchGroup(30, "unicast", loss);
+            benchGroup(30, "group", loss);
+            benchGroup(30, "acked", loss);
+        }
+        benchGroupFrames("bitmap", {1}, 40, 1);
+        benchGroupFrames("interleaved", {5, 6, 5}, 1, 2);
+    }
+    if (benchSelected("tdma"))
+    {
+        for (bool tdma : {false, true})
+        {
+            benchTdma(30, 200, false, tdma);
+            benchTdma(32, 100, false, tdma);
+            benchTdma(32, 100, true, tdma);
+            benchTdma(32, 50, true, tdma);
+        }
+    }
+    if (benchSelected("clock"))
+    {
+        benchClock(10, 1000, 0);
+        benchClock(10, 10000, 0);
+        benchClock(10, 1000, 16);
+    }
+    if (benchSelected("peers"))
+    {
+        benchPeers(15, 20);
+        benchPeers(30, 20);
+    }
+    if (benchSelected("reliable"))
+    {
+        benchReliable(0.0f);
+        benchReliable(0.1f);
+        benchReliable(0.2f);
+    }
+    if (benchSelected("priority"))
+    {
+        benchPriority(false);
+        benchPriority(true);
+    }
+    if (benchSelected("async"))
+    {
+        benchAsync(false);
+        benchAsync(true);
+    }
+    if (benchSelected("batching"))
+    {
+        benchBatching(0);
+        benchBatching(NOW_BATCH_DELAY);
+        benchBatchOrder();
+    }
+    if (benchSelected("codec"))
+    {
+        benchCompressionCodec("json", makeJson);
+        benchCompressionCodec("json x3", makeJsonBatch);
+        benchCompressionCodec("csv", makeCsv);
+    }
+    if (benchSelected("compression"))
+    {
+        benchCompression(false);
+        benchCompression(true);
+    }
+    if (benchSelected("topics")) benchTopics(4);
+    if (benchSelected("idle")) benchIdle(5, 600000);
+    if (benchSelected("liveness"))
+    {
+        benchLiveness(5, NOW_HEARTBEAT_INTERVAL, NOW_LIVENESS_PHI, 0);
+        benchLiveness(5, NOW_HEARTBEAT_INTERVAL, NOW_LIVENESS_PHI, 1000);
+        benchLiveness(5, 10000, NOW_LIVENESS_PHI, 0);
+        benchLiveness(5, 10000, 3, 0);
+        benchLiveness(5, 1000, NOW_LIVENESS_PHI, 0);
+    }
+    if (benchSelected("log")) benchLog();
+    if (benchSelected("leases"))
+    {
+        benchLeases(4, 0);
+        benchLeases(4, 10);
+        benchLeases(4, 50);
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+//  Arduino.h - minimal host stand-in so the service (without the ESP-NOW
+//  transport) builds and runs in a native Linux process
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+
+class String
+{
+private:
+    std::string buffer;
+
+public:
+    String() {}
+    String(const char *s) : buffer(s ? s : "") {}
+    String(const std::string &s) : buffer(s) {}
+    String(char c) : buffer(1, c) {}
+    String(int v) : buffer(std::to_string(v)) {}
+    String(unsigned int v) : buffer(std::to_string(v)) {}
+    String(long v) : buffer(std::to_string(v)) {}
+    String(unsigned long v) : buffer(std::to_string(v)) {}
+    String(long long v) : buffer(std::to_string(v)) {}
+    String(unsigned long long v) : buffer(std::to_string(v)) {}
+    String(float v) : buffer(std::to_string(v)) {}
+    String(double v) : buffer(std::to_string(v)) {}
+
+    const char *c_str() const { return buffer.c_str(); }
+    unsigned int length() const { return (unsigned int)buffer.length(); }
+    bool isEmpty() const { return buffer.empty(); }
+    String substring(unsigned int from) const { return (from < buffer.length()) ? String(buffer.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        if (from >= buffer.length() || to <= from) return String();
+        return String(buffer.substr(from, to - from));
+    }
+
+    String &operator+=(const String &rhs) { buffer += rhs.buffer; return *this; }
+    bool operator==(const String &rhs) const { return buffer == rhs.buffer; }
+    bool operator!=(const String &rhs) const { return buffer != rhs.buffer; }
+    friend String operator+(const String &lhs, const String &rhs) { return String(lhs.buffer + rhs.buffer); }
+    friend String operator+(const char *lhs, const String &rhs) { return String(std::string(lhs) + rhs.buffer); }
+    friend String operator+(const String &lhs, const char *rhs) { return String(lhs.buffer + rhs); }
+};
+
+class HostSerial
+{
+public:
+    void begin(unsigned long) {}
+    void print(const String &s) { fputs(s.c_str(), stdout); }
+    void println(const String &s) { puts(s.c_str()); }
+    void println() { puts(""); }
+};
+
+inline HostSerial Serial;
+
+inline unsigned long micros()
+{
+    static const auto start = std::chrono::steady_clock::now();
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline unsigned long millis()
+{
+    return micros() / 1000;
+}
+
+inline void delay(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
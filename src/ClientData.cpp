@@ -1,10 +1,12 @@
+#include <Helpers.h>
 #include "ClientData.h"
 
 ClientData::ClientData()
 {
 }
 
-ClientData::ClientData(String name, String macAddress, int state)
-    : name(name), macAddress(macAddress), state(state)
+ClientData::ClientData(String name, const uint8_t *mac, int state)
+    : key(Helpers::macToKey(mac)), name(name), state(state)
 {
+    Helpers::parseMac(mac, this->mac);
 }
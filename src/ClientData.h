@@ -2,15 +2,23 @@
 
 #include <Arduino.h>
 
+#include "Reliable.h"
+#include "NowLiveness.h"
+
 #define CLIENT_DATA_NEW 0
 #define CLIENT_DATA_CONFIRM 1
 
+//  per-client session held by the server
 struct ClientData
 {
-    String macAddress;
+    uint64_t key = 0;           //  MAC packed by Helpers::macToKey
+    uint8_t mac[6] = {0};
     String name;
     int state = CLIENT_DATA_NEW;
+    NowLiveness liveness;
+    unsigned long advertisedAt = 0;     //  start of the current binding attempt
+    PeerLink link;
 
     ClientData();
-    ClientData(String name, String macAddress, int state);
+    ClientData(String name, const uint8_t *mac, int state);
 };
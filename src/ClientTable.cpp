@@ -0,0 +1,121 @@
+#include <Helpers.h>
+#include "ClientTable.h"
+
+static const int indexMask = NOW_CLIENT_TABLE_SIZE - 1;
+
+ClientTable::ClientTable()
+{
+    clear();
+}
+
+int ClientTable::hash(uint64_t key)
+{
+    //  vendor prefixes repeat, so mix all bits before masking
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (int)(key & indexMask);
+}
+
+int ClientTable::findIndex(uint64_t key) const
+{
+    for (int i = hash(key);; i = (i + 1) & indexMask)
+    {
+        if (indexSlots[i] < 0) return -1;
+        if (indexKeys[i] == key) return i;
+    }
+}
+
+ClientData *ClientTable::find(uint64_t key)
+{
+    int i = findIndex(key);
+    return (i < 0) ? nullptr : &slots[indexSlots[i]];
+}
+
+ClientData *ClientTable::find(const uint8_t *mac)
+{
+    return find(Helpers::macToKey(mac));
+}
+
+ClientData *ClientTable::insert(const uint8_t *mac, bool &created)
+{
+    created = false;
+    uint64_t key = Helpers::macToKey(mac);
+    int i = hash(key);
+    for (; indexSlots[i] >= 0; i = (i + 1) & indexMask)
+    {
+        if (indexKeys[i] == key) return &slots[indexSlots[i]];
+    }
+    if (used >= NOW_MAX_CLIENTS) return nullptr;
+
+    int slot = 0;
+    while (slotUsed[slot]) slot++;
+    slotUsed[slot] = true;
+    slots[slot] = ClientData("", mac, CLIENT_DATA_NEW);
+    indexKeys[i] = key;
+    indexSlots[i] = (int8_t)slot;
+    used++;
+    created = true;
+    return &slots[slot];
+}
+
+bool ClientTable::remove(uint64_t key)
+{
+    int i = findIndex(key);
+    if (i < 0) return false;
+    slotUsed[indexSlots[i]] = false;
+    slots[indexSlots[i]] = ClientData();
+    used--;
+
+    //  backward-shift deletion keeps probe chains intact without tombstones
+    int hole = i;
+    for (int j = (i + 1) & indexMask; indexSlots[j] >= 0; j = (j + 1) & indexMask)
+    {
+        int home = hash(indexKeys[j]);
+        //  move j into the hole unless its home lies cyclically in (hole, j]
+        bool between = (hole <= j) ? ((home > hole) && (home <= j)) : ((home > hole) || (home <= j));
+        if (between) continue;
+        indexKeys[hole] = indexKeys[j];
+        indexSlots[hole] = indexSlots[j];
+        hole = j;
+    }
+    indexSlots[hole] = -1;
+    indexKeys[hole] = 0;
+    return true;
+}
+
+void ClientTable::clear()
+{
+    for (int i = 0; i < NOW_CLIENT_TABLE_SIZE; i++)
+    {
+        indexSlots[i] = -1;
+        indexKeys[i] = 0;
+    }
+    for (int i = 0; i < NOW_MAX_CLIENTS; i++)
+    {
+        slotUsed[i] = false;
+        slots[i] = ClientData();
+    }
+    used = 0;
+}
+
+int ClientTable::count() const
+{
+    return used;
+}
+
+int ClientTable::capacity() const
+{
+    return NOW_MAX_CLIENTS;
+}
+
+ClientData *ClientTable::at(int slot)
+{
+    if ((slot < 0) || (slot >= NOW_MAX_CLIENTS) || !slotUsed[slot]) return nullptr;
+    return &slots[slot];
+}
+
+int ClientTable::slotOf(const ClientData *client) const
+{
+    return (int)(client - slots);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "ClientData.h"
+
+//  maximum concurrent client sessions on a server
+#ifndef NOW_MAX_CLIENTS
+#define NOW_MAX_CLIENTS 32
+#endif
+
+//  open-addressing index size, power of two and at least twice the clients
+#ifndef NOW_CLIENT_TABLE_SIZE
+#define NOW_CLIENT_TABLE_SIZE 64
+#endif
+
+static_assert((NOW_CLIENT_TABLE_SIZE & (NOW_CLIENT_TABLE_SIZE - 1)) == 0, "NOW_CLIENT_TABLE_SIZE must be a power of two");
+static_assert(NOW_CLIENT_TABLE_SIZE >= 2 * NOW_MAX_CLIENTS, "NOW_CLIENT_TABLE_SIZE must be at least twice NOW_MAX_CLIENTS");
+static_assert(NOW_MAX_CLIENTS < 128, "slot indices are stored as int8_t");
+
+//  fixed-capacity session table keyed by the packed 48-bit MAC. Sessions
+//  live in a stable slot array, a linear-probing index maps keys to slots.
+class ClientTable
+{
+private:
+    ClientData slots[NOW_MAX_CLIENTS];
+    bool slotUsed[NOW_MAX_CLIENTS] = {false};
+    uint64_t indexKeys[NOW_CLIENT_TABLE_SIZE] = {0};
+    int8_t indexSlots[NOW_CLIENT_TABLE_SIZE];
+    int used = 0;
+
+    static int hash(uint64_t key);
+    int findIndex(uint64_t key) const;
+
+public:
+    ClientTable();
+
+    ClientData *find(uint64_t key);
+    ClientData *find(const uint8_t *mac);
+    //  returns the existing session, a new one, or nullptr when full
+    ClientData *insert(const uint8_t *mac, bool &created);
+    bool remove(uint64_t key);
+    void clear();
+
+    int count() const;
+    int capacity() const;
+    //  stable for the lifetime of the session, nullptr if the slot is free
+    ClientData *at(int slot);
+    int slotOf(const ClientData *client) const;
+};
@@ -0,0 +1,119 @@
+#ifdef ESP_PLATFORM
+
+#include <WiFi.h>
+#include <cstring>
+#include "esp_wifi.h"
+#include "esp_now.h"
+
+#include "EspNowTransport.h"
+#include "NowDebug.h"
+
+EspNowTransport::EspNowTransport()
+{
+}
+
+EspNowTransport *EspNowTransport::instance()
+{
+    static EspNowTransport transport;
+    return &transport;
+}
+
+bool EspNowTransport::begin(ReceiveCallback onReceive, SentCallback onSent)
+{
+    this->onReceive = onReceive;
+    this->onSent = onSent;
+
+    //  initialize wifi first
+    WiFi.mode(WIFI_STA);
+    if (esp_now_init() != ESP_OK)
+    {
+        printDebug("    (begin) Error initializing ESP-NOW", 1);
+        return false;
+    }
+    //  register callbacks
+    esp_now_register_send_cb(esp_now_send_cb_t(sentHandler));
+    esp_now_register_recv_cb(esp_now_recv_cb_t(receiveHandler));
+    return true;
+}
+
+bool EspNowTransport::readMacAddress(uint8_t *mac)
+{
+    return esp_wifi_get_mac(WIFI_IF_STA, mac) == ESP_OK;
+}
+
+bool EspNowTransport::send(const uint8_t *mac, const uint8_t *data, int len)
+{
+    esp_err_t result = esp_now_send(mac, data, len);
+    return (result == ESP_OK) ? true : false;
+}
+
+bool EspNowTransport::hasPeer(const uint8_t *mac)
+{
+    return esp_now_is_peer_exist(mac);
+}
+
+bool EspNowTransport::addPeer(const uint8_t *mac, uint8_t channel)
+{
+    esp_now_peer_info_t peer;
+    memset(&peer, 0, sizeof(esp_now_peer_info_t));
+    peer.channel = channel;
+    peer.encrypt = false;
+    memcpy(peer.peer_addr, mac, 6);
+    return esp_now_add_peer(&peer) == ESP_OK;
+}
+
+bool EspNowTransport::removePeer(const uint8_t *mac)
+{
+    return esp_now_del_peer(mac) == ESP_OK;
+}
+
+bool EspNowTransport::setChannel(uint8_t channel)
+{
+    //  refused while the station is connected to an AP
+    return esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE) == ESP_OK;
+}
+
+uint8_t EspNowTransport::getChannel()
+{
+    uint8_t primary = 0;
+    wifi_second_chan_t second;
+    if (esp_wifi_get_channel(&primary, &second) != ESP_OK) return 0;
+    return primary;
+}
+
+unsigned long EspNowTransport::millis()
+{
+    return ::millis();
+}
+
+unsigned long EspNowTransport::micros()
+{
+    return ::micros();
+}
+
+void EspNowTransport::delay(unsigned long ms)
+{
+    //  the worker sleeps on its task notification so wake() can cut it short
+    workerTask = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ms));
+}
+
+void EspNowTransport::wake()
+{
+    TaskHandle_t task = static_cast<TaskHandle_t>(workerTask);
+    if (task) xTaskNotifyGive(task);
+}
+
+void EspNowTransport::sentHandler(const uint8_t *mac, int status)
+{
+    EspNowTransport *transport = instance();
+    if (transport->onSent) transport->onSent(mac, status == ESP_NOW_SEND_SUCCESS);
+}
+
+void EspNowTransport::receiveHandler(const uint8_t *mac, const uint8_t *incomingData, int len)
+{
+    EspNowTransport *transport = instance();
+    if (transport->onReceive) transport->onReceive(mac, incomingData, len);
+}
+
+#endif // ESP_PLATFORM
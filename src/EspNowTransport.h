@@ -0,0 +1,35 @@
+#pragma once
+
+#include "NowTransport.h"
+
+//  ESP-NOW driver transport - the driver only supports a single set of
+//  callbacks, so there is one shared instance per device
+class EspNowTransport : public NowTransport
+{
+private:
+    ReceiveCallback onReceive;
+    SentCallback onSent;
+    void *workerTask = nullptr;
+
+    EspNowTransport();
+
+    static void sentHandler(const uint8_t *mac, int status);
+    static void receiveHandler(const uint8_t *mac, const uint8_t *incomingData, int len);
+
+public:
+    static EspNowTransport *instance();
+
+    bool begin(ReceiveCallback onReceive, SentCallback onSent) override;
+    bool readMacAddress(uint8_t *mac) override;
+    bool send(const uint8_t *mac, const uint8_t *data, int len) override;
+    bool hasPeer(const uint8_t *mac) override;
+    bool addPeer(const uint8_t *mac, uint8_t channel) override;
+    bool removePeer(const uint8_t *mac) override;
+    bool setChannel(uint8_t channel) override;
+    uint8_t getChannel() override;
+
+    unsigned long millis() override;
+    unsigned long micros() override;
+    void delay(unsigned long ms) override;
+    void wake() override;
+};
@@ -63,3 +63,23 @@ bool Helpers::macIsEmpty(const uint8_t *mac, int len)
     }
     return true;
 }
+
+uint64_t Helpers::macToKey(const uint8_t *mac)
+{
+    //  48-bit MAC packed big-endian into the low bits
+    uint64_t key = 0;
+    for (int i = 0; i < 6; i++)
+    {
+        key = (key << 8) | mac[i];
+    }
+    return key;
+}
+
+void Helpers::keyToMac(uint64_t key, uint8_t *mac)
+{
+    for (int i = 5; i >= 0; i--)
+    {
+        mac[i] = (uint8_t)(key & 0xff);
+        key >>= 8;
+    }
+}
@@ -13,6 +13,8 @@ public:
     static void parseMac(const String &s, uint8_t *mac);
     static void parseMac(const uint8_t *inMac, uint8_t *outMac);
     static bool macIsEmpty(const uint8_t *mac, int len);
+    static uint64_t macToKey(const uint8_t *mac);
+    static void keyToMac(uint64_t key, uint8_t *mac);
 
 private:
     Helpers() = delete;
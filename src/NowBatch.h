@@ -0,0 +1,37 @@
+// NowBatch.h
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "NowMsg.h"
+
+// default Nagle-style delay before a partial batch goes out, in ms
+#ifndef NOW_BATCH_DELAY
+#define NOW_BATCH_DELAY 5
+#endif
+
+// NOW_DT_DATA payload with NOW_FLAG_BATCH: messages back to back, each
+// prefixed with its length in one byte
+static const size_t NOW_BATCH_PREFIX = 1;
+static const size_t NOW_MAX_BATCHED  = NOW_MAX_PAYLOAD - NOW_BATCH_PREFIX;
+
+// appends a message to a batch holding used bytes, false when it doesn't fit
+inline bool batchAppend(uint8_t* batch, int& used, const uint8_t* data, int len) {
+  if (len <= 0 || len > (int)NOW_MAX_BATCHED) return false;
+  if (used + (int)NOW_BATCH_PREFIX + len > (int)NOW_MAX_PAYLOAD) return false;
+  batch[used] = (uint8_t)len;
+  memcpy(batch + used + NOW_BATCH_PREFIX, data, len);
+  used += NOW_BATCH_PREFIX + len;
+  return true;
+}
+
+// steps through a received batch - false at the end or on a malformed entry
+inline bool batchNext(const uint8_t* batch, int length, int& offset, const uint8_t*& data, int& len) {
+  if (offset + (int)NOW_BATCH_PREFIX > length) return false;
+  len = batch[offset];
+  if (len == 0 || offset + (int)NOW_BATCH_PREFIX + len > length) return false;
+  data = batch + offset + NOW_BATCH_PREFIX;
+  offset += NOW_BATCH_PREFIX + len;
+  return true;
+}
@@ -1,134 +1,497 @@
-#include "esp_now.h"
-
 #include <Helpers.h>
 #include "NowClient.h"
 #include "NowMsg.h"
 #include "NowDebug.h"
 
-NowClient::NowClient(String name)
-    : name(name)
+NowClient::NowClient(String name, NowTransport *transport)
+    : NowService(transport), name(name)
 {
     role = ServiceRole::Client;
+    forgetGroupIds();
 }
 
 NowClient::~NowClient()
 {
 }
 
+void NowClient::setAdvertising(unsigned long interval, unsigned long maxInterval, int burst, int jitter)
+{
+    advertiseInterval = interval;
+    advertiseMaxInterval = (maxInterval > interval) ? maxInterval : interval;
+    advertiseBurst = burst;
+    advertiseJitter = (jitter < 0) ? 0 : ((jitter > 100) ? 100 : jitter);
+}
+
+void NowClient::setScanning(bool enabled, uint8_t channel)
+{
+    scanning = enabled;
+    if (channel) foundChannel = channel;
+}
+
+uint8_t NowClient::channel() const
+{
+    return foundChannel;
+}
+
+void NowClient::setRelay(bool enabled)
+{
+    relay = enabled;
+}
+
+void NowClient::setClockSync(unsigned long interval)
+{
+    syncInterval.store(interval, std::memory_order_relaxed);
+    //  the timers are the worker's, before begin() the first bind starts it
+    syncChanged.store(true, std::memory_order_relaxed);
+    if (transport) transport->wake();
+}
+
+void NowClient::joinGroup(uint8_t group)
+{
+    if ((group == 0) || (group > NOW_GROUPS)) return;
+    groupMask |= 1UL << (group - 1);
+}
+
+void NowClient::leaveGroup(uint8_t group)
+{
+    if ((group == 0) || (group > NOW_GROUPS)) return;
+    groupMask &= ~(1UL << (group - 1));
+}
+
 void NowClient::beginAdverise()
 {
     Helpers::setFlag(Advertise, serviceMode);
-    advertiseLast = 0;     //  advertise immediately
+    timers.cancel(receiveTimer);
+    advertiseStart = transport->millis();
+    advertiseCount = 0;
+    scanIndex = -1;
+    askRelay = false;
+    //  try where the server was last found before sweeping
+    if (scanning && foundChannel) transport->setChannel(foundChannel);
+    //  advertise right away, give or take the jitter
+    timers.arm(advertiseTimer, advertiseStart + nextRandom(advertiseInterval * advertiseJitter / 100 + 1));
+}
+
+unsigned long NowClient::spread(unsigned long interval)
+{
+    unsigned long range = interval * advertiseJitter / 100;
+    return interval - range + nextRandom(2 * range + 1);
 }
 
 void NowClient::endAdvertise()
 {
     Helpers::unsetFlag(Advertise, serviceMode);
+    timers.cancel(advertiseTimer);
 }
 
-void NowClient::advertise(unsigned long now, unsigned long ticks)
+unsigned long NowClient::backoff()
+{
+    //  burst, then back off
+    int doublings = advertiseCount + 2 - advertiseBurst;
+    if (doublings <= 0) return advertiseInterval;
+    if ((doublings < 16) && ((advertiseInterval << doublings) < advertiseMaxInterval)) return advertiseInterval << doublings;
+    return advertiseMaxInterval;
+}
+
+void NowClient::advertise(unsigned long now)
 {
     if (!Helpers::flagIsSet(Advertise, serviceMode)) return;
-    
-    receiveLast = millis();
-    unsigned long elapsed = now - advertiseLast;
-    if (elapsed > advertiseInterval)
+
+    //  without a known channel, or once its burst went unanswered, every
+    //  advertisement becomes a sweep over all channels
+    if (scanning && (!foundChannel || (advertiseCount >= advertiseBurst)))
     {
-        advertiseLast = now;
-        printDebug("(advertise) Preparing to advertise...", 0);
-        // payload = client name as bytes (no NUL needed)
-        NowMsg msg{};
-        const uint8_t* p = reinterpret_cast<const uint8_t*>(name.c_str());
-        uint16_t n = (uint16_t)name.length();  // cap to 230 if you want
-        if (!buildMsg(msg, NOW_DT_ADVERTISE, macAddress, broadcastMac, p, n, millis())) return;
-        sendMsg(broadcastMac, msg);    }
+        scan(now);
+        return;
+    }
+    unsigned long interval = backoff();
+    advertiseCount++;
+    timers.arm(advertiseTimer, now + spread(interval));
+    sendAdvertisement();
 }
 
-void NowClient::work(unsigned long now, unsigned long ticks) 
+void NowClient::scan(unsigned long now)
 {
-    //  must we advertise
-    advertise(now, ticks);
-    //  check idle timeout for re-advertise
-    checkTimeout(now);
+    if (scanIndex < 0)
+    {
+        scanIndex = 0;
+        NowMetrics::count(counters.channelScans);
+    }
+    uint8_t channel = NOW_SCAN_FIRST + scanIndex;
+    printDebug("(scan) Advertising on channel " + String(channel), 0);
+    if (!transport->setChannel(channel))
+    {
+        printDebug("    (scan) Unable to switch channel", 1);
+    }
+    sendAdvertisement();
+    if (++scanIndex <= NOW_SCAN_LAST - NOW_SCAN_FIRST)
+    {
+        //  long enough for a connect to come back
+        timers.arm(advertiseTimer, now + NOW_SCAN_DWELL);
+        return;
+    }
+    //  the last channel gets its dwell as well before backing off
+    scanIndex = -1;
+    unsigned long interval = backoff();
+    advertiseCount++;
+    timers.arm(advertiseTimer, now + NOW_SCAN_DWELL + spread(interval));
+}
+
+void NowClient::sendAdvertisement()
+{
+    printDebug("(advertise) Preparing to advertise...", 0);
+    nowLog(NOW_LOG_ADVERTISE, 0, 0, 0);
+    NowMetrics::count(counters.advertisements);
+    // payload = client name as bytes (no NUL needed)
+    NowMsg msg{};
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(name.c_str());
+    uint16_t n = (uint16_t)name.length();  // cap to NOW_MAX_PAYLOAD if you want
+    if (!buildMsg(msg, NOW_DT_ADVERTISE, macAddress, broadcastMac, p, n)) return;
+    //  the server didn't hear the burst - maybe a relay will pass it on
+    if (askRelay || (advertiseCount > advertiseBurst)) msg.flags |= NOW_FLAG_RELAY;
+    sendMsg(broadcastMac, msg);
 }
 
 void NowClient::dataReceived(const uint8_t *mac, const uint8_t *incomingData, int len)
 {
     printDebug("(dataReceived) Received data from: " + Helpers::macToString(mac) + ", length: " + String(len), 0);
 
-    String myMac = Helpers::macToString(macAddress);
     //  check that we didn't receive our own data
     if (Helpers::macEquals(macAddress, mac))
     {
-        printDebug("*** (dataReceived) We received our own data - " + myMac + ", " + Helpers::macToString(mac), 0);
+        printDebug("*** (dataReceived) We received our own data - " + Helpers::macToString(macAddress) + ", " + Helpers::macToString(mac), 0);
         return;
     }
 
     //  deserialize incoming data
-    if (!validateMsg(incomingData, len)) return;
-    receiveLast = millis();
-    const NowMsg* m = reinterpret_cast<const NowMsg*>(incomingData);
+    NowMsg scratch;
+    const NowMsg* m = decodeFrame(mac, incomingData, len, scratch);
+    if (!m) return;
 
-    //  only our bound server can send us anything except a connect message
-    if ((m->datatype > NOW_DT_CONNECT) && !Helpers::macEquals(m->fromMac, boundMac))
+    const Route &route = routes[m->datatype];
+    if (!route.handler) return;
+    //  only our bound server can send us anything but connect and solicit
+    if (route.bound && !Helpers::macEquals(m->fromMac, boundMac))
     {
         printDebug("    (dataReceived) *** Received data from a different source: " + Helpers::macToString(m->fromMac) + ". Ignoring (" + Helpers::macToString(boundMac) + ")", 1);
+        NowMetrics::count(counters.droppedUnbound);
         return;
     }
+    //  other clients' advertisements don't prove the server is still there
+    if (route.bound) serverLiveness.heard(transport->millis());
+    (this->*route.handler)(mac, m);
+}
+
+//  what the client does with each datatype - bound routes only accept
+//  frames from the bound server
+const NowClient::Route NowClient::routes[NOW_DT_COUNT] = {
+    {nullptr, false},                           //  NOW_DT_ADVERTISE
+    {&NowClient::connectReceived, false},       //  NOW_DT_CONNECT
+    {nullptr, false},                           //  NOW_DT_HANDSHAKE
+    {&NowClient::ackReceived, true},            //  NOW_DT_ACK
+    {&NowClient::heartbeatReceived, true},      //  NOW_DT_HEARTBEAT
+    {&NowClient::dataFrameReceived, true},      //  NOW_DT_DATA
+    {&NowClient::fragmentFrameReceived, true},  //  NOW_DT_FRAGMENT
+    {&NowClient::dataAckFrameReceived, true},   //  NOW_DT_DATA_ACK
+    {&NowClient::solicitReceived, false},       //  NOW_DT_SOLICIT
+    {&NowClient::groupReceived, true},          //  NOW_DT_GROUP
+    {nullptr, false},                           //  NOW_DT_GROUP_ACK
+    {&NowClient::beaconReceived, false},        //  NOW_DT_BEACON
+};
+
+void NowClient::connectReceived(const uint8_t *mac, const NowMsg *m)
+{
+    printDebug("    (dataReceived-1) Accepting CONNECT from server", 1);
+    // ensure message aimed at us
+    if (!Helpers::macEquals(macAddress, m->toMac)) return;
+    //  only an answer to our advertising - once bound, a repeated or stale
+    //  CONNECT from another server must not take us away from ours
+    if (!Helpers::flagIsSet(Advertise, serviceMode) && !Helpers::macEquals(m->fromMac, boundMac)) return;
+    lockChannel();
+    addSourceMac(m->fromMac);
+    Helpers::parseMac(m->fromMac, boundMac);
+    // send HANDSHAKE back
+    printDebug("    (dataReceived-1) Initiate Handshake", 1);
+    NowMsg out{};
+    //  so the server knows how often to expect us
+    NowLivenessInfo info;
+    info.heartbeatInterval = heartbeatInterval;
+    if (buildMsg(out, NOW_DT_HANDSHAKE, macAddress, m->fromMac, &info, sizeof(info)))
+      sendMsg(mac, out);
+    //  hold off advertising until the ack, unless it never comes
+    printDebug("    (dataReceived-1) Pause advertising", 1);
+    timers.arm(advertiseTimer, transport->millis() + NOW_HANDSHAKE_TIMEOUT);
+}
+
+void NowClient::ackReceived(const uint8_t *mac, const NowMsg *m)
+{
+    printDebug("    (dataReceieved-3) Handshake complete. Stop advertising and receiving on omni channel", 1);
+    endAdvertise();
+    //  unsubscribe from omni channel
+    removeSourceMac(broadcastMac);
+    //  fresh sequence space for a new binding
+    bool newlyBound = !Helpers::flagIsSet(Bound, serviceMode);
+    if (newlyBound)
+    {
+        serverLink.reset();
+        unsigned long now = transport->millis();
+        serverLiveness.reset(now, heartbeatInterval);
+        serverSentAt.store(now, std::memory_order_relaxed);
+        serverAckedAt.store(now, std::memory_order_relaxed);
+        forgetGroupIds();
+        //  a different server, or the same one restarted
+        clock.reset();
+        syncCount = 0;
+        syncOrigin = 0;
+        NowMetrics::count(counters.binds);
+        counters.timeToBind.record(transport->millis() - advertiseStart);
+    }
+    //  we're now up and running
+    Helpers::setFlag(Running, serviceMode);
+    Helpers::setFlag(Bound, serviceMode);
+    countHb = 0;
+    timers.arm(receiveTimer, transport->millis());
+    serverMac = Helpers::macToString(m->fromMac);
+    Helpers::parseMac(m->fromMac, boundMac);
+    if (m->length >= sizeof(NowBindInfo))
+    {
+        NowBindInfo info;
+        memcpy(&info, m->payload, sizeof(info));
+        groupSlot = info.slot;
+    }
+    printDebug("    (dataReceived-3) Now connected to server: " + serverMac + " (" + Helpers::macToString(boundMac) + ")", 1);
+    nowLog(NOW_LOG_BOUND, Helpers::macToKey(boundMac), 0, 0);
+    if (onPeerBound) onPeerBound(Helpers::macToString(boundMac));
+    if (syncInterval.load(std::memory_order_relaxed) && newlyBound) timers.arm(syncTimer, transport->millis());
+    //  nodes out of the server's range may be waiting for a relay
+    if (relay && newlyBound) sendSolicit(NOW_SOLICIT_WINDOW, NOW_FLAG_RELAY);
+}
 
-    if (m->datatype == NOW_DT_CONNECT)
-    {
-        printDebug("    (dataReceived-1) Accepting CONNECT from server", 1);
-        // ensure message aimed at us
-        if (!Helpers::macEquals(macAddress, m->toMac)) return;
-        addSourceMac(m->fromMac);
-        Helpers::parseMac(m->fromMac, boundMac);
-        // send HANDSHAKE back
-        printDebug("    (dataReceived-1) Initiate Handshake", 1);
-        NowMsg out{};
-        if (buildMsg(out, NOW_DT_HANDSHAKE, macAddress, m->fromMac, nullptr, 0, millis()))
-          sendMsg(mac, out);
-        //  stop advertising
-        printDebug("    (dataReceived-1) Stop advertising", 1);
-        endAdvertise();
-    }
-    else if (m->datatype == NOW_DT_ACK)
-    {
-        receiveLast = millis();
-        printDebug("    (dataReceieved-3) Handshake complete. Stop receiving on omni channel", 1);
-        //  unsubscribe from omni channel
-        removeSourceMac(broadcastMac);
-        //  we're now up and running
-        Helpers::setFlag(Running, serviceMode);
-        Helpers::setFlag(Bound, serviceMode);
-        serverMac = Helpers::macToString(m->fromMac);
-        Helpers::parseMac(m->fromMac, boundMac);
-        printDebug("    (dataReceived-3) Now connected to server: " + serverMac + " (" + Helpers::macToString(boundMac) + ")", 1);
-        if (onPeerBound) onPeerBound(Helpers::macToString(boundMac));
-    }
-    else if (m->datatype == NOW_DT_HEARTBEAT)
-    {
-        receiveLast = millis();
-        printDebug("    (dataReceived-4) Heartbeat received from server. Timeout reset.", 1);
-        countHb = 0;
-    }
-    else if (m->datatype == NOW_DT_DATA)
-    {
-        receiveLast = millis();
-        //  make received data available to the consumer
-        uint16_t n = m->length;
-        if (!onDataReceived || (n == 0) || (n > sizeof(m->payload))) return;
-        uint8_t *copy = static_cast<uint8_t *>(malloc(n));
-        if (!copy) return;
-        memcpy(copy, m->payload, n);
-        onDataReceived(copy, static_cast<int>(n));
-        free(copy);
+void NowClient::heartbeatReceived(const uint8_t *mac, const NowMsg *m)
+{
+    NowClockSync sync{};
+    if (m->length >= sizeof(sync)) memcpy(&sync, m->payload, sizeof(sync));
+    //  the server probing us
+    if (!sync.origin && sync.sent)
+    {
+        printDebug("    (dataReceived-4) Heartbeat request from server.", 1);
+        sendHeartbeat(m->fromMac, &sync);
         return;
     }
+    printDebug("    (dataReceived-4) Heartbeat received from server. Timeout reset.", 1);
+    countHb = 0;
+    if (heartbeatSentAt)
+    {
+        counters.heartbeatRtt.record(transport->millis() - heartbeatSentAt);
+        heartbeatSentAt = 0;
+    }
+    //  the answer to our latest only - an older one came back late
+    if (!syncOrigin || (sync.origin != syncOrigin)) return;
+    syncOrigin = 0;
+    clock.sample(sync.origin, sync.received, sync.sent, receivedMicros());
+}
+
+void NowClient::syncClock(unsigned long now)
+{
+    unsigned long every = syncInterval.load(std::memory_order_relaxed);
+    if (!every || !Helpers::flagIsSet(Bound, serviceMode)) return;
+    syncOrigin = sendHeartbeat(boundMac);
+    syncCount++;
+    unsigned long interval = (syncCount < NOW_CLOCK_SAMPLES) ? every / NOW_CLOCK_SAMPLES : every;
+    timers.arm(syncTimer, now + spread(interval ? interval : 1));
+}
+
+void NowClient::dataFrameReceived(const uint8_t *mac, const NowMsg *m)
+{
+    if (!reliableReceived(m->fromMac, m, &serverLink)) return;
+    deliverFrame(m->fromMac, m);
+}
+
+void NowClient::fragmentFrameReceived(const uint8_t *mac, const NowMsg *m)
+{
+    if (!reliableReceived(m->fromMac, m, &serverLink)) return;
+    fragmentReceived(m->fromMac, m);
+}
+
+void NowClient::dataAckFrameReceived(const uint8_t *mac, const NowMsg *m)
+{
+    dataAckReceived(m->fromMac, m, &serverLink);
+}
+
+void NowClient::groupReceived(const uint8_t *mac, const NowMsg *m)
+{
+    if (m->length < sizeof(NowGroupHeader)) return;
+    NowGroupHeader header;
+    memcpy(&header, m->payload, sizeof(header));
+    int prefix = sizeof(header) + header.bitmapLength;
+    if (prefix > m->length) return;
+    //  by group id, or by our bit in the slot bitmap. Our turn to
+    //  acknowledge is our place among the recipients.
+    int turn = groupSlot;
+    if (header.group)
+    {
+        if ((header.group > NOW_GROUPS) || !(groupMask & (1UL << (header.group - 1)))) return;
+    }
+    else
+    {
+        if ((groupSlot < 0) || ((groupSlot >> 3) >= header.bitmapLength)) return;
+        //  a server with more slots than ours sends a longer bitmap, only
+        //  our part of it fits
+        NowRecipients recipients;
+        int bitmapLength = (header.bitmapLength < NOW_GROUP_BITMAP) ? header.bitmapLength : NOW_GROUP_BITMAP;
+        memcpy(recipients.bits, m->payload + sizeof(header), bitmapLength);
+        if (!recipients.test(groupSlot)) return;
+        turn = recipients.rank(groupSlot);
+    }
+    if (header.flags & NOW_GROUP_ACK)
+    {
+        //  one ack outstanding, an earlier one goes now
+        unsigned long now = transport->millis();
+        if (groupAckId >= 0) sendGroupAck(now);
+        groupAckId = header.msgId;
+        timers.arm(groupAckTimer, now + (unsigned long)turn * NOW_GROUP_ACK_SPACING);
+    }
+    //  a resend after our ack got lost
+    if (groupIdSeen(header.msgId)) return;
+    recentGroupIds[recentGroupNext] = header.msgId;
+    recentGroupNext = (recentGroupNext + 1) % NOW_GROUP_RECENT;
+    deliverData(m->fromMac, m->payload + prefix, m->length - prefix);
+}
+
+bool NowClient::groupIdSeen(uint16_t msgId) const
+{
+    for (int32_t id : recentGroupIds)
+    {
+        if (id == msgId) return true;
+    }
+    return false;
+}
+
+void NowClient::forgetGroupIds()
+{
+    for (int32_t &id : recentGroupIds) id = -1;
+    recentGroupNext = 0;
+}
+
+void NowClient::sendGroupAck(unsigned long now)
+{
+    timers.cancel(groupAckTimer);
+    if (groupAckId < 0) return;
+    NowGroupAck ack;
+    ack.msgId = (uint16_t)groupAckId;
+    groupAckId = -1;
+    if (!Helpers::flagIsSet(Bound, serviceMode)) return;
+    NowMsg out{};
+    if (buildMsg(out, NOW_DT_GROUP_ACK, macAddress, boundMac, &ack, sizeof(ack)))
+        sendMsg(boundMac, out);
+}
+
+void NowClient::beaconReceived(const uint8_t *mac, const NowMsg *m)
+{
+    //  our server's schedule, or any server's while we look for one
+    bool bound = Helpers::flagIsSet(Bound, serviceMode);
+    if ((bound && !Helpers::macEquals(m->fromMac, boundMac)) || (m->length < sizeof(NowTdmaBeacon))) return;
+    NowTdmaBeacon beacon;
+    memcpy(&beacon, m->payload, sizeof(beacon));
+    //  the superframe started as the server sent the beacon - with synced
+    //  clocks we know how long it took to get here
+    uint32_t start = receivedMicros() - ((rxLatency > 0) ? (uint32_t)rxLatency : 0);
+    {
+        std::lock_guard<std::recursive_mutex> lock(txLock);
+        tdma.start(start, beacon);
+    }
+    if (bound) serverLiveness.alive(transport->millis());
+}
+
+void NowClient::solicitReceived(const uint8_t *mac, const NowMsg *m)
+{
+    if (!Helpers::flagIsSet(Advertise, serviceMode)) return;
+    printDebug("    (dataReceived-8) Server solicits advertisements", 1);
+    unsigned long window = NOW_SOLICIT_WINDOW;
+    if (m->length >= sizeof(NowSolicit))
+    {
+        NowSolicit solicit;
+        memcpy(&solicit, m->payload, sizeof(solicit));
+        window = solicit.window;
+    }
+    //  answer somewhere in the window and burst again from there - through
+    //  the relay, when it was one asking
+    if (m->flags & NOW_FLAG_RELAY) askRelay = true;
+    lockChannel();
+    advertiseCount = 0;
+    timers.arm(advertiseTimer, transport->millis() + nextRandom(window + 1));
+}
+
+void NowClient::lockChannel()
+{
+    if (!scanning) return;
+    //  the server is on the channel we're on - stop sweeping
+    scanIndex = -1;
+    foundChannel = transport->getChannel();
+    printDebug("    (lockChannel) Server found on channel " + String(foundChannel), 1);
+}
+
+PeerLink *NowClient::peerLink(const uint8_t *mac)
+{
+    if (!Helpers::flagIsSet(Bound, serviceMode) || !Helpers::macEquals(mac, boundMac)) return nullptr;
+    return &serverLink;
+}
+
+void NowClient::peerMetrics(NowMetricsSnapshot &out)
+{
+    if (!Helpers::flagIsSet(Bound, serviceMode)) return;
+    memcpy(out.peers[0].mac, boundMac, 6);
+    out.peers[0].lastSeen = serverLiveness.lastHeard();
+    out.peerCount = 1;
+}
+
+void NowClient::dataSent(const uint8_t *mac, bool success)
+{
+    NowService::dataSent(mac, success);
+    if (!Helpers::flagIsSet(Bound, serviceMode) || !Helpers::macEquals(mac, boundMac)) return;
+    unsigned long now = transport->millis();
+    serverSentAt.store(now, std::memory_order_relaxed);
+    if (success) serverAckedAt.store(now, std::memory_order_relaxed);
+    else
+    {
+        //  the worker probes the server rather than wait for the silence
+        serverMissed.store(true, std::memory_order_relaxed);
+        transport->wake();
+    }
+}
+
+void NowClient::work(unsigned long now, unsigned long ticks)
+{
+    if (serverMissed.exchange(false, std::memory_order_relaxed)) checkTimeout(now);
+    if ((syncTimer >= 0) && syncChanged.exchange(false, std::memory_order_relaxed))
+    {
+        if (syncInterval.load(std::memory_order_relaxed) && Helpers::flagIsSet(Bound, serviceMode)) timers.arm(syncTimer, now);
+        else timers.cancel(syncTimer);
+    }
+}
+
+bool NowClient::slotted(uint32_t nowUs)
+{
+    return tdma.active(nowUs);
+}
+
+uint32_t NowClient::slotWait(uint8_t datatype, uint32_t nowUs)
+{
+    if (!tdma.active(nowUs)) return 0;
+    //  binding goes in the contention window, the rest in our slot once
+    //  the schedule has one
+    int window = NowTdma::Contention;
+    bool binding = (datatype == NOW_DT_ADVERTISE) || (datatype == NOW_DT_HANDSHAKE);
+    if (!binding && Helpers::flagIsSet(Bound, serviceMode) && (groupSlot >= 0) && (groupSlot < tdma.slots())) window = groupSlot;
+    return tdma.wait(nowUs, window);
 }
 
 void NowClient::initialize()
 {
+    advertiseTimer = timers.add([this](unsigned long now) { advertise(now); });
+    receiveTimer = timers.add([this](unsigned long now) { checkTimeout(now); });
+    groupAckTimer = timers.add([this](unsigned long now) { sendGroupAck(now); });
+    syncTimer = timers.add([this](unsigned long now) { syncClock(now); });
     //  begin advertising
     Helpers::setFlag(Advertise, serviceMode);
     printDebug("(initialize) Starting client, advertise interval: " + String(advertiseInterval), 0);
@@ -140,28 +503,51 @@ void NowClient::checkTimeout(unsigned long now)
 {
     if (!Helpers::flagIsSet(Running, serviceMode)) return;
 
-    unsigned long elapsed = now - receiveCheckLast;
-    if (elapsed <= receiveCheckInterval) return;
-    receiveCheckLast = now;
-
-    elapsed = now - receiveLast;
-    //  should we request a heartbeat?
-    if (elapsed <= receiveTimeout) return;
-    printDebug("(checkTimeout) Requesting heartbeat after " + String(elapsed) + "ms.", 0);
-    uint8_t sMac[6];
-    Helpers::parseMac(serverMac, sMac);
-    sendHeartbeat(sMac);
-    countHb++;
-
-    if (countHb < 3) return;
+    //  acked since the last check
+    unsigned long acked = serverAckedAt.load(std::memory_order_relaxed);
+    if ((long)(acked - serverLiveness.lastHeard()) > 0) serverLiveness.alive(acked);
+    if (serverSentAt.load(std::memory_order_relaxed) != acked) serverLiveness.missed();
+    unsigned long next;
+    NowLiveness::Verdict verdict = serverLiveness.check(now, suspectDeviations, next);
+    unsigned long elapsed = now - serverLiveness.lastHeard();
+    if (verdict != NowLiveness::Dead)
+    {
+        //  a heartbeat once either direction was quiet for the interval,
+        //  sooner when the server is suspected
+        unsigned long sent = serverSentAt.load(std::memory_order_relaxed);
+        unsigned long quiet = ((long)(sent - serverLiveness.lastHeard()) < 0) ? sent : serverLiveness.lastHeard();
+        unsigned long fill = quiet + heartbeatInterval;
+        if ((verdict == NowLiveness::Probe) || ((long)(now - fill) >= 0))
+        {
+            printDebug("(checkTimeout) Requesting heartbeat after " + String(elapsed) + "ms.", 0);
+            syncOrigin = sendHeartbeat(boundMac);
+            heartbeatSentAt = now;
+            if (verdict == NowLiveness::Probe)
+            {
+                NowMetrics::count(counters.probes);
+                countHb++;
+            }
+            nowLog(NOW_LOG_HEARTBEAT, Helpers::macToKey(boundMac), countHb, 0);
+            fill = now + heartbeatInterval;
+        }
+        timers.arm(receiveTimer, ((long)(fill - next) < 0) ? fill : next);
+        return;
+    }
     printDebug("    (checkTimeout) We haven't received anything for " + String(elapsed) + "ms, returning advertising", 1);
     //  we're not running anymore
+    nowLog(NOW_LOG_UNBOUND, Helpers::macToKey(boundMac), 0, 0);
+    NowMetrics::count(counters.unbinds);
+    heartbeatSentAt = 0;
+    syncOrigin = 0;
+    timers.cancel(syncTimer);
+    forgetPeer(boundMac);
+    forgetRoute(boundMac);
     serverMac = "";
     memset(boundMac, 0x0, 6);
     Helpers::unsetFlag(Running, serviceMode);
     Helpers::unsetFlag(Bound, serviceMode);
     //  read omni channel
-    addSourceMac(broadcastMac);
+    addSourceMac(broadcastMac, PEER_FIXED);
     //  start advertising
     beginAdverise();
 }
@@ -6,30 +6,110 @@
 class NowClient : public NowService
 {
 private:
-    unsigned long advertiseInterval = 1000;
-    unsigned long advertiseLast = 0;
-    unsigned long receiveTimeout = 60000;
-    unsigned long receiveLast = 0;
-    unsigned long receiveCheckInterval = 5000;  //  check every second / 5 seconds
-    unsigned long receiveCheckLast = 0;
+    unsigned long advertiseInterval = NOW_ADVERTISE_INTERVAL;
+    unsigned long advertiseMaxInterval = NOW_ADVERTISE_MAX_INTERVAL;
+    int advertiseBurst = NOW_ADVERTISE_BURST;
+    int advertiseJitter = NOW_ADVERTISE_JITTER;
+    int advertiseCount = 0;
+    bool scanning = false;
+    uint8_t foundChannel = 0;
+    int scanIndex = -1;         //  channel being swept, -1 between sweeps
+    bool askRelay = false;      //  a relay solicited us
+    NowLiveness serverLiveness;
+    //  from the send results - the driver's acks prove the server is
+    //  there as much as its frames do
+    std::atomic<unsigned long> serverSentAt{0};
+    std::atomic<unsigned long> serverAckedAt{0};
+    std::atomic<bool> serverMissed{false};
     int countHb = 0;
+    unsigned long advertiseStart = 0;
+    unsigned long heartbeatSentAt = 0;
+    int advertiseTimer = -1;
+    int receiveTimer = -1;
+    int groupSlot = -1;         //  our bit in group bitmaps, from the ACK
+    uint32_t groupMask = 0;     //  bit g-1 for group g
+    //  group messages are resent to the ones missing, the ids seen last
+    int32_t recentGroupIds[NOW_GROUP_RECENT];
+    int recentGroupNext = 0;
+    int32_t groupAckId = -1;    //  waiting for our turn to acknowledge
+    int groupAckTimer = -1;
+    std::atomic<unsigned long> syncInterval{NOW_CLOCK_SYNC_INTERVAL};
+    std::atomic<bool> syncChanged{false};   //  for the worker to start or stop syncing
+    int syncCount = 0;          //  sync heartbeats since binding
+    uint32_t syncOrigin = 0;    //  our heartbeat waiting for an answer
+    int syncTimer = -1;
     
     String serverMac;
+    PeerLink serverLink;
 
     void beginAdverise();
-    void advertise(unsigned long now, unsigned long ticks);
+    void advertise(unsigned long now);
+    void sendAdvertisement();
+    unsigned long backoff();
+    void scan(unsigned long now);
+    void lockChannel();
     void endAdvertise();
+    unsigned long spread(unsigned long interval);
     void checkTimeout(unsigned long now);
+    void syncClock(unsigned long now);
+
+    using Handler = void (NowClient::*)(const uint8_t *mac, const NowMsg *m);
+    struct Route
+    {
+        Handler handler;
+        bool bound;     //  only from the bound server
+    };
+    static const Route routes[NOW_DT_COUNT];
+
+    void connectReceived(const uint8_t *mac, const NowMsg *m);
+    void ackReceived(const uint8_t *mac, const NowMsg *m);
+    void heartbeatReceived(const uint8_t *mac, const NowMsg *m);
+    void dataFrameReceived(const uint8_t *mac, const NowMsg *m);
+    void fragmentFrameReceived(const uint8_t *mac, const NowMsg *m);
+    void dataAckFrameReceived(const uint8_t *mac, const NowMsg *m);
+    void solicitReceived(const uint8_t *mac, const NowMsg *m);
+    void groupReceived(const uint8_t *mac, const NowMsg *m);
+    bool groupIdSeen(uint16_t msgId) const;
+    void forgetGroupIds();
+    void sendGroupAck(unsigned long now);
+    void beaconReceived(const uint8_t *mac, const NowMsg *m);
 
 protected:
-    void work(unsigned long now, unsigned long ticks) override;
     void initialize() override;
+    void dataSent(const uint8_t *mac, bool success) override;
+    void work(unsigned long now, unsigned long ticks) override;
+    bool slotted(uint32_t nowUs) override;
+    uint32_t slotWait(uint8_t datatype, uint32_t nowUs) override;
+    PeerLink *peerLink(const uint8_t *mac) override;
+    void peerMetrics(NowMetricsSnapshot &out) override;
 
 public:
     String name = "";
 
-    NowClient(String name);
+    NowClient(String name, NowTransport *transport = nullptr);
     ~NowClient();
 
+    //  advertise burst times interval ms apart, then back off doubling up to
+    //  maxInterval, each interval spread by +-jitter percent
+    void setAdvertising(unsigned long interval, unsigned long maxInterval, int burst = NOW_ADVERTISE_BURST, int jitter = NOW_ADVERTISE_JITTER);
+    //  look for the server on every channel, NOW_SCAN_DWELL ms each, trying
+    //  the one it was last found on first. Pass channel() from a previous
+    //  run to reconnect without a sweep. Only while WiFi isn't connected,
+    //  the radio has to hop.
+    void setScanning(bool enabled, uint8_t channel = 0);
+    //  where the server was found, 0 until then
+    uint8_t channel() const;
+    //  while bound, pass frames on between the server and nodes out of its
+    //  range - their advertisements once a burst went unanswered, and
+    //  everything after that in both directions
+    void setRelay(bool enabled);
+    //  receive the server's sendGroup() to group 1..NOW_GROUPS
+    void joinGroup(uint8_t group);
+    void leaveGroup(uint8_t group);
+    //  heartbeat the server every interval ms while bound to keep the
+    //  clock synced, the first NOW_CLOCK_SAMPLES times faster. 0 = only
+    //  when the server went quiet.
+    void setClockSync(unsigned long interval);
+
     void dataReceived(const uint8_t *mac, const uint8_t *incomingData, int len) override;
 };
@@ -0,0 +1,122 @@
+#include "NowClock.h"
+
+void NowClock::reset()
+{
+    count = 0;
+    next = 0;
+    synced = reference;
+    base = 0;
+    baseOffset = 0;
+    drift = 0.0f;
+    bestDelay = 0;
+    anchored = false;
+}
+
+void NowClock::setReference()
+{
+    reference = true;
+    reset();
+}
+
+bool NowClock::sample(uint32_t origin, uint32_t received, uint32_t sent, uint32_t arrived)
+{
+    if (reference) return false;
+    int32_t total = (int32_t)(arrived - origin);
+    int32_t turnaround = (int32_t)(sent - received);
+    if ((total < 0) || (turnaround < 0)) return false;
+    //  both clocks tick in whole units, the server's turnaround can come
+    //  out longer than the round trip
+    int32_t delay = (total > turnaround) ? total - turnaround : 0;
+    Sample &s = samples[next];
+    s.at = origin + (uint32_t)(total / 2);
+    s.offset = (int32_t)(((int64_t)(int32_t)(received - origin) + (int32_t)(sent - arrived)) / 2);
+    s.delay = (uint32_t)delay;
+    next = (next + 1) % NOW_CLOCK_SAMPLES;
+    if (count < NOW_CLOCK_SAMPLES) count++;
+    fit();
+    return true;
+}
+
+void NowClock::fit()
+{
+    //  the offset at the newest sample, averaged over the newer half that
+    //  came back about as fast as the fastest of them, with the drift taken
+    //  out. Older ones can't be carried far with a drift not yet known well.
+    int newest = (next + NOW_CLOCK_SAMPLES - 1) % NOW_CLOCK_SAMPLES;
+    uint32_t ref = samples[newest].at;
+    int32_t refOffset = samples[newest].offset;
+    const int recent = (count + 1) / 2;
+    uint32_t fastest = UINT32_MAX;
+    for (int k = 0; k < recent; k++)
+    {
+        const Sample &s = samples[(newest + NOW_CLOCK_SAMPLES - k) % NOW_CLOCK_SAMPLES];
+        if (s.delay < fastest) fastest = s.delay;
+    }
+    bestDelay = fastest;
+    int n = 0;
+    float sum = 0.0f;
+    for (int k = 0; k < recent; k++)
+    {
+        const Sample &s = samples[(newest + NOW_CLOCK_SAMPLES - k) % NOW_CLOCK_SAMPLES];
+        int32_t x = (int32_t)(s.at - ref);
+        if (s.delay > fastest + NOW_CLOCK_JITTER) continue;
+        sum += (float)(s.offset - refOffset) - drift * (float)x;
+        n++;
+    }
+    base = ref;
+    baseOffset = refOffset + (int32_t)(sum / n);
+    synced = true;
+
+    if (!anchored)
+    {
+        //  once the window is full, the first estimate worth measuring from
+        if (count < NOW_CLOCK_SAMPLES) return;
+        anchored = true;
+        anchor = base;
+        anchorOffset = baseOffset;
+        return;
+    }
+    int32_t span = (int32_t)(base - anchor);
+    if (span < (int32_t)NOW_CLOCK_DRIFT_SPAN * 1000) return;
+    drift = (float)(baseOffset - anchorOffset) / (float)span;
+    //  30 minutes is plenty, and far from wrapping
+    if (span > 1800000000L)
+    {
+        anchor = base;
+        anchorOffset = baseOffset;
+    }
+}
+
+bool NowClock::isSynced() const
+{
+    return synced;
+}
+
+uint32_t NowClock::toNetwork(uint32_t local) const
+{
+    if (!synced || reference) return local;
+    return local + (uint32_t)(baseOffset + (int32_t)(drift * (float)(int32_t)(local - base)));
+}
+
+uint32_t NowClock::toLocal(uint32_t network) const
+{
+    if (!synced || reference) return network;
+    //  the drift term moves by less than a µs per ms, one step is enough
+    uint32_t local = network - (uint32_t)baseOffset;
+    return network - (uint32_t)(baseOffset + (int32_t)(drift * (float)(int32_t)(local - base)));
+}
+
+int32_t NowClock::offset() const
+{
+    return baseOffset;
+}
+
+float NowClock::driftPpm() const
+{
+    return drift * 1e6f;
+}
+
+uint32_t NowClock::delay() const
+{
+    return bestDelay;
+}
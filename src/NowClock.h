@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+
+//  clock samples kept, the offset is averaged over the newer half of them
+//  that made the round trip about as fast as the fastest
+#ifndef NOW_CLOCK_SAMPLES
+#define NOW_CLOCK_SAMPLES 8
+#endif
+
+//  µs a round trip may take beyond the fastest and still count
+#ifndef NOW_CLOCK_JITTER
+#define NOW_CLOCK_JITTER 500
+#endif
+
+//  ms of samples before the drift is measured from the offset's change
+//  since - the longer, the less a sample's jitter shows in it
+#ifndef NOW_CLOCK_DRIFT_SPAN
+#define NOW_CLOCK_DRIFT_SPAN 10000
+#endif
+
+//  ms between clock sync heartbeats once bound, 0 = only the liveness
+//  heartbeats carry samples. The first NOW_CLOCK_SAMPLES go out faster.
+#ifndef NOW_CLOCK_SYNC_INTERVAL
+#define NOW_CLOCK_SYNC_INTERVAL 0
+#endif
+
+//  NOW_DT_HEARTBEAT payload, µs on each side's own clock. A request only
+//  fills in sent, the answer echoes it in origin.
+struct __attribute__((packed)) NowClockSync {
+    uint32_t origin;        //  sent of the heartbeat answered, 0 for none
+    uint32_t received;      //  when that heartbeat arrived
+    uint32_t sent;
+};
+
+//  NTP-style estimate of the server's µs clock from heartbeat round
+//  trips - origin, received, sent and the arrival of the answer. The
+//  offset comes from the recent samples with the shortest round trips,
+//  where the path is the most symmetric. The drift is how far that offset
+//  moved since an anchor at least NOW_CLOCK_DRIFT_SPAN back, a short
+//  window would mostly measure jitter. µs values wrap every 71 minutes and
+//  are compared as differences, so the anchor moves up before half that.
+class NowClock
+{
+private:
+    struct Sample
+    {
+        uint32_t at;        //  local µs halfway through the round trip
+        int32_t offset;     //  server minus local
+        uint32_t delay;     //  round trip without the server's turnaround
+    };
+
+    Sample samples[NOW_CLOCK_SAMPLES];
+    int count = 0;
+    int next = 0;
+    bool reference = false;
+    bool synced = false;
+    uint32_t base = 0;
+    int32_t baseOffset = 0;
+    float drift = 0.0f;     //  µs the offset moves per local µs
+    uint32_t bestDelay = 0;
+    bool anchored = false;
+    uint32_t anchor = 0;
+    int32_t anchorOffset = 0;
+
+    void fit();
+
+public:
+    void reset();
+    //  this node's clock is the one the others follow
+    void setReference();
+    //  one heartbeat round trip, false when it can't be used
+    bool sample(uint32_t origin, uint32_t received, uint32_t sent, uint32_t arrived);
+    bool isSynced() const;
+    //  a local µs reading on the server's clock, and back
+    uint32_t toNetwork(uint32_t local) const;
+    uint32_t toLocal(uint32_t network) const;
+    int32_t offset() const;
+    //  parts per million this clock runs slow against the server
+    float driftPpm() const;
+    //  the fastest recent round trip, µs
+    uint32_t delay() const;
+};
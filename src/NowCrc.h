@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+//  CRC-16/X-25 (reflected 0x1021, inverted in and out), the variant the
+//  ESP32 ROM implements. Chains: nowCrc16(nowCrc16(0, a, n), b, m) is the
+//  CRC of a followed by b.
+uint16_t nowCrc16(uint16_t crc, const uint8_t *data, size_t len);
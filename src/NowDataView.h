@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "NowTopic.h"
+
+//  received data in place - a read-only window on the buffer the frame (or
+//  the reassembled message) arrived in. A view handed to the application
+//  is leased: the buffer stays untouched until NowService::release(view).
+struct NowDataView
+{
+    enum Source : uint8_t
+    {
+        Transient,      //  valid during the callback only
+        Frame,          //  a receive ring slot
+        Message         //  a reassembly buffer
+    };
+
+    const uint8_t *data = nullptr;
+    int length = 0;
+    uint8_t mac[6] = {0};
+    //  millis() when the frame, or the last fragment, arrived
+    unsigned long timestamp = 0;
+    //  µs from the sender handing the frame over to its arrival, -1 unless
+    //  both ends have synced clocks
+    int32_t latency = -1;
+    uint8_t topic = NOW_NO_TOPIC;
+
+    Source source = Transient;
+    int16_t slot = -1;
+};
@@ -1,9 +1,93 @@
-#include "NowDebug.h"
+#include <atomic>
 
-const int NOW_DEBUG_LEVEL = -1;
+#include "NowDebug.h"
 
-void printDebug(const String &info, int level)
+void printDebugLine(const String &info)
 {
-    if (level > NOW_DEBUG_LEVEL) return;
     Serial.println(info);
 }
+
+#if NOW_LOG_RING > 0
+
+static NowLogRecord logRing[NOW_LOG_RING];
+//  per record, its index + 1 once written, 0 while a writer is at it
+static std::atomic<uint32_t> logCommit[NOW_LOG_RING];
+static std::atomic<uint32_t> logHead{0};
+static uint32_t logTail = 0;
+
+void nowLogRecord(uint8_t event, int32_t a, int32_t b, int32_t c)
+{
+    //  the driver callbacks log too, every writer claims its own record
+    uint32_t index = logHead.fetch_add(1, std::memory_order_relaxed);
+    std::atomic<uint32_t> &commit = logCommit[index & (NOW_LOG_RING - 1)];
+    commit.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    NowLogRecord &record = logRing[index & (NOW_LOG_RING - 1)];
+    record.time = (uint32_t)micros();
+    record.event = event;
+    record.args[0] = a;
+    record.args[1] = b;
+    record.args[2] = c;
+    commit.store(index + 1, std::memory_order_release);
+}
+
+int nowLogRead(NowLogRecord *records, int max)
+{
+    uint32_t head = logHead.load(std::memory_order_acquire);
+    //  older records were overwritten
+    if (head - logTail > NOW_LOG_RING) logTail = head - NOW_LOG_RING;
+    int count = 0;
+    while ((logTail != head) && (count < max))
+    {
+        uint32_t slot = logTail & (NOW_LOG_RING - 1);
+        uint32_t seen = logCommit[slot].load(std::memory_order_acquire);
+        if ((int32_t)(seen - (logTail + 1)) < 0)
+        {
+            //  claimed but not written yet, the next read picks it up -
+            //  unless a writer a lap ahead is overwriting it
+            if (logHead.load(std::memory_order_acquire) - logTail <= NOW_LOG_RING) break;
+            logTail++;
+            continue;
+        }
+        logTail++;
+        //  a newer record took its place
+        if (seen != logTail) continue;
+        records[count] = logRing[slot];
+        //  and kept only if no writer came by during the copy
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (logCommit[slot].load(std::memory_order_relaxed) == seen) count++;
+    }
+    return count;
+}
+
+#else
+
+int nowLogRead(NowLogRecord *records, int max)
+{
+    return 0;
+}
+
+#endif
+
+String nowLogFormat(const NowLogRecord &record)
+{
+    static const char *const names[NOW_LOG_EVENTS] = {
+        "received", "rejected", "sent", "send failed", "send done",
+        "advertise", "bound", "unbound", "heartbeat", "rx overrun"};
+    char line[96];
+    const char *name = (record.event < NOW_LOG_EVENTS) ? names[record.event] : "?";
+    //  peers are logged as the low 32 bits of the MAC
+    snprintf(line, sizeof(line), "%10lu %-12s %08lx %ld %ld", (unsigned long)record.time, name,
+             (unsigned long)(uint32_t)record.args[0], (long)record.args[1], (long)record.args[2]);
+    return String(line);
+}
+
+void nowLogDump()
+{
+    NowLogRecord records[16];
+    int count;
+    while ((count = nowLogRead(records, 16)) > 0)
+    {
+        for (int i = 0; i < count; i++) Serial.println(nowLogFormat(records[i]));
+    }
+}
@@ -2,9 +2,66 @@
 #define NOW_DEBUG_H
 
 #include <Arduino.h>
+#include <stdint.h>
 
-extern const int NOW_DEBUG_LEVEL;
+//  highest level printed, -1 = none. Selected at build time - statements
+//  above it are dead code and their arguments are never evaluated.
+#ifndef NOW_DEBUG_LEVEL
+#define NOW_DEBUG_LEVEL -1
+#endif
 
-void printDebug(const String &info, int level = 0);
+//  binary log records kept for nowLogDump(), power of two, 0 = off
+#ifndef NOW_LOG_RING
+#define NOW_LOG_RING 0
+#endif
+
+static_assert((NOW_LOG_RING & (NOW_LOG_RING - 1)) == 0, "NOW_LOG_RING must be a power of two");
+
+void printDebugLine(const String &info);
+
+#define printDebug(info, level)                                 \
+    do                                                          \
+    {                                                           \
+        if ((level) <= NOW_DEBUG_LEVEL) printDebugLine(info);   \
+    } while (0)
+
+//  binary log events, the arguments are listed in nowLogFormat
+enum NowLogEvent : uint8_t
+{
+    NOW_LOG_RECEIVED,       //  peer, datatype, length
+    NOW_LOG_REJECTED,       //  peer, length
+    NOW_LOG_SENT,           //  peer, datatype, length
+    NOW_LOG_SEND_FAILED,    //  peer, datatype, length
+    NOW_LOG_SEND_DONE,      //  peer, success
+    NOW_LOG_ADVERTISE,      //  -
+    NOW_LOG_BOUND,          //  peer
+    NOW_LOG_UNBOUND,        //  peer
+    NOW_LOG_HEARTBEAT,      //  peer, attempt
+    NOW_LOG_RX_OVERRUN,     //  peer, length
+    NOW_LOG_EVENTS
+};
+
+struct NowLogRecord
+{
+    uint32_t time;          //  micros()
+    uint8_t event;
+    int32_t args[3];
+};
+
+#if NOW_LOG_RING > 0
+void nowLogRecord(uint8_t event, int32_t a, int32_t b, int32_t c);
+//  a few stores - formatting happens in nowLogDump()
+#define nowLog(event, a, b, c) nowLogRecord((event), (int32_t)(a), (int32_t)(b), (int32_t)(c))
+#else
+#define nowLog(event, a, b, c) do {} while (0)
+#endif
+
+//  copies out up to max records, oldest first, and empties the ring. Safe
+//  while others log: a record still being written ends the read, one
+//  overwritten during the copy is skipped.
+int nowLogRead(NowLogRecord *records, int max);
+//  formats and prints the records kept so far
+void nowLogDump();
+String nowLogFormat(const NowLogRecord &record);
 
 #endif // NOW_DEBUG_H
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+
+//  an unbound client advertises NOW_ADVERTISE_BURST times
+//  NOW_ADVERTISE_INTERVAL ms apart, then doubles the interval up to
+//  NOW_ADVERTISE_MAX_INTERVAL. Every interval, and the first advertisement,
+//  is spread by +-NOW_ADVERTISE_JITTER percent so nodes powered up together
+//  don't stay in lockstep.
+#ifndef NOW_ADVERTISE_BURST
+#define NOW_ADVERTISE_BURST 3
+#endif
+
+#ifndef NOW_ADVERTISE_INTERVAL
+#define NOW_ADVERTISE_INTERVAL 50
+#endif
+
+#ifndef NOW_ADVERTISE_MAX_INTERVAL
+#define NOW_ADVERTISE_MAX_INTERVAL 4000
+#endif
+
+#ifndef NOW_ADVERTISE_JITTER
+#define NOW_ADVERTISE_JITTER 50
+#endif
+
+//  ms over which clients spread their answers to a solicit
+#ifndef NOW_SOLICIT_WINDOW
+#define NOW_SOLICIT_WINDOW 100
+#endif
+
+//  a client that answered a connect advertises again when no ack came back
+//  within this many ms - the handshake or the ack got lost on the way
+#ifndef NOW_HANDSHAKE_TIMEOUT
+#define NOW_HANDSHAKE_TIMEOUT 500
+#endif
+
+//  channels a scanning client sweeps, and how long it listens on each for
+//  a connect - a sweep takes at most 13 * NOW_SCAN_DWELL ms
+#ifndef NOW_SCAN_FIRST
+#define NOW_SCAN_FIRST 1
+#endif
+
+#ifndef NOW_SCAN_LAST
+#define NOW_SCAN_LAST 13
+#endif
+
+#ifndef NOW_SCAN_DWELL
+#define NOW_SCAN_DWELL 30
+#endif
+
+//  NOW_DT_SOLICIT payload
+struct __attribute__((packed)) NowSolicit {
+    uint16_t window;    //  answer within this many ms
+};
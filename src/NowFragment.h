@@ -0,0 +1,60 @@
+// NowFragment.h
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include "NowMsg.h"
+
+// largest message sendData will fragment and the receiver will reassemble.
+// Every node holds NOW_REASSEMBLY_SLOTS buffers of this size, so raise both
+// only when the application sends large messages, e.g. in platformio.ini:
+//   build_flags = -DNOW_MAX_MESSAGE=16384 -DNOW_REASSEMBLY_SLOTS=4
+#ifndef NOW_MAX_MESSAGE
+#define NOW_MAX_MESSAGE 4096
+#endif
+
+// messages that can be reassembled at the same time
+#ifndef NOW_REASSEMBLY_SLOTS
+#define NOW_REASSEMBLY_SLOTS 2
+#endif
+
+// drop a partial message when no fragment arrived for this long
+#ifndef NOW_FRAGMENT_TIMEOUT
+#define NOW_FRAGMENT_TIMEOUT 2000
+#endif
+
+// NOW_DT_FRAGMENT payload
+struct __attribute__((packed)) NowFragment {
+  uint16_t msgId;       // per sender, wraps
+  uint16_t totalLength; // bytes in the whole message
+  uint8_t  index;       // 0..count-1
+  uint8_t  count;       // fragments in the message
+  uint8_t  data[NOW_MAX_PAYLOAD - 6];  // 223 - 6-byte fragment header = 217
+};
+
+static_assert(sizeof(NowFragment) == NOW_MAX_PAYLOAD, "NowFragment must fill the NowMsg payload");
+
+static const size_t NOW_FRAGMENT_HEADER = offsetof(NowFragment, data);  // 6
+static const size_t NOW_FRAGMENT_DATA   = sizeof(NowFragment::data);
+
+static_assert(NOW_MAX_MESSAGE <= 65535, "NOW_MAX_MESSAGE must fit the 16-bit length");
+static_assert(NOW_MAX_MESSAGE <= 255 * NOW_FRAGMENT_DATA, "NOW_MAX_MESSAGE needs more than 255 fragments");
+
+inline uint8_t fragmentCount(uint16_t totalLength) {
+  return (uint8_t)((totalLength + NOW_FRAGMENT_DATA - 1) / NOW_FRAGMENT_DATA);
+}
+
+// bytes carried by fragment index of a message
+inline uint16_t fragmentLength(uint16_t totalLength, uint8_t index) {
+  size_t offset = (size_t)index * NOW_FRAGMENT_DATA;
+  size_t left = totalLength - offset;
+  return (uint16_t)((left < NOW_FRAGMENT_DATA) ? left : NOW_FRAGMENT_DATA);
+}
+
+inline bool validateFragment(const NowMsg& m) {
+  if (m.length < NOW_FRAGMENT_HEADER) return false;
+  const NowFragment* f = reinterpret_cast<const NowFragment*>(m.payload);
+  if (f->totalLength == 0 || f->totalLength > NOW_MAX_MESSAGE) return false;
+  if (f->count != fragmentCount(f->totalLength) || f->index >= f->count) return false;
+  return (m.length - NOW_FRAGMENT_HEADER) == fragmentLength(f->totalLength, f->index);
+}
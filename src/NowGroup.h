@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "ClientTable.h"
+
+//  group sends collecting acknowledgements at the same time
+#ifndef NOW_GROUP_PENDING
+#define NOW_GROUP_PENDING 4
+#endif
+
+//  recipients acknowledge one after the other this many ms apart, in the
+//  order of their slots, rather than all at once into each other
+#ifndef NOW_GROUP_ACK_SPACING
+#define NOW_GROUP_ACK_SPACING 1
+#endif
+
+//  ms to wait past the last recipient's turn before the frame goes out
+//  again to the clients that are missing
+#ifndef NOW_GROUP_ACK_TIMEOUT
+#define NOW_GROUP_ACK_TIMEOUT 20
+#endif
+
+#ifndef NOW_GROUP_RETRIES
+#define NOW_GROUP_RETRIES 2
+#endif
+
+//  group messages a client remembers to drop resends of - the server
+//  resends up to NOW_GROUP_PENDING of them interleaved
+#ifndef NOW_GROUP_RECENT
+#define NOW_GROUP_RECENT (2 * NOW_GROUP_PENDING)
+#endif
+
+static_assert(NOW_GROUP_RECENT >= NOW_GROUP_PENDING, "NOW_GROUP_RECENT must cover the pending group sends");
+
+//  group ids clients can join, 1..NOW_GROUPS - 0 addresses by slot
+#ifndef NOW_GROUPS
+#define NOW_GROUPS 32
+#endif
+
+static_assert(NOW_GROUPS <= 32, "group membership is a 32-bit mask");
+
+static const int NOW_GROUP_BITMAP = (NOW_MAX_CLIENTS + 7) / 8;
+
+//  a set of server session slots
+struct NowRecipients
+{
+    uint8_t bits[NOW_GROUP_BITMAP] = {0};
+
+    void set(int slot) { bits[slot >> 3] |= (uint8_t)(1 << (slot & 7)); }
+    void reset(int slot) { bits[slot >> 3] &= (uint8_t)~(1 << (slot & 7)); }
+    bool test(int slot) const { return (slot >= 0) && (slot < NOW_MAX_CLIENTS) && (bits[slot >> 3] & (1 << (slot & 7))); }
+    int count() const
+    {
+        int n = 0;
+        for (int i = 0; i < NOW_MAX_CLIENTS; i++) n += test(i);
+        return n;
+    }
+    //  how many slots in the set come before slot
+    int rank(int slot) const
+    {
+        int n = 0;
+        for (int i = 0; i < slot; i++) n += test(i);
+        return n;
+    }
+    //  bytes up to the last slot in the set, what goes on the air
+    int length() const
+    {
+        int n = NOW_GROUP_BITMAP;
+        while ((n > 0) && !bits[n - 1]) n--;
+        return n;
+    }
+};
+
+//  NowGroupHeader::flags
+static const uint8_t NOW_GROUP_ACK = 0x01;     //  recipients acknowledge
+
+//  NOW_DT_GROUP payload - the header, bitmapLength bytes of NowRecipients
+//  when group is 0, then the data
+struct __attribute__((packed)) NowGroupHeader {
+    uint16_t msgId;         //  the same for every resend
+    uint8_t group;          //  0 = the bitmap says who
+    uint8_t flags;          //  NOW_GROUP_ACK
+    uint8_t bitmapLength;
+};
+
+//  NOW_DT_GROUP_ACK payload
+struct __attribute__((packed)) NowGroupAck {
+    uint16_t msgId;
+};
+
+//  NOW_DT_ACK payload - where the client's session lives on the server
+struct __attribute__((packed)) NowBindInfo {
+    uint8_t slot;
+};
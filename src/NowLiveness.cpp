@@ -0,0 +1,90 @@
+#include <math.h>
+#include "NowLiveness.h"
+
+//  gains of the smoothed gap and its deviation, as for TCP's SRTT/RTTVAR
+static const float meanGain = 0.125f;
+static const float deviationGain = 0.25f;
+//  a normal distribution's standard deviation from its mean deviation
+static const float deviationScale = 1.25f;
+
+void NowLiveness::reset(unsigned long now, unsigned long expected)
+{
+    last = now;
+    mean = (float)expected;
+    deviation = (float)expected / 4;
+    probes = 0;
+    suspected = false;
+}
+
+void NowLiveness::heard(unsigned long now)
+{
+    float gap = (float)(long)(now - last);
+    if (gap < 0) return;
+    last = now;
+    probes = 0;
+    suspected = false;
+    float error = gap - mean;
+    mean += meanGain * error;
+    deviation += deviationGain * (fabsf(error) - deviation);
+}
+
+void NowLiveness::alive(unsigned long now)
+{
+    if ((long)(now - last) < 0) return;
+    last = now;
+    probes = 0;
+    suspected = false;
+}
+
+void NowLiveness::missed()
+{
+    suspected = true;
+}
+
+unsigned long NowLiveness::lastHeard() const
+{
+    return last;
+}
+
+unsigned long NowLiveness::suspectAt(float deviations) const
+{
+    float sigma = deviation * deviationScale;
+    if (sigma < NOW_LIVENESS_MIN_DEVIATION) sigma = NOW_LIVENESS_MIN_DEVIATION;
+    return last + (unsigned long)(mean + deviations * sigma);
+}
+
+NowLiveness::Verdict NowLiveness::check(unsigned long now, float deviations, unsigned long &next)
+{
+    if (!probes)
+    {
+        next = suspectAt(deviations);
+        if (!suspected && ((long)(now - next) < 0)) return Alive;
+    }
+    else if ((long)(now - probedAt) < NOW_LIVENESS_PROBE_TIMEOUT)
+    {
+        next = probedAt + NOW_LIVENESS_PROBE_TIMEOUT;
+        return Alive;
+    }
+    else if (probes >= NOW_LIVENESS_PROBES) return Dead;
+    probes++;
+    probedAt = now;
+    next = now + NOW_LIVENESS_PROBE_TIMEOUT;
+    return Probe;
+}
+
+float NowLiveness::deviations(float phi)
+{
+    //  phi(y) = -log10(e / (1 + e)), e = exp(-y (1.5976 + 0.070566 y^2)),
+    //  the logistic approximation of the normal distribution's tail used by
+    //  Akka and Cassandra. Solved for y, Newton on the exponent.
+    float p = powf(10.0f, -phi);
+    float t = logf((1.0f - p) / p);
+    float y = 1.0f;
+    for (int i = 0; i < 20; i++)
+    {
+        float f = y * (1.5976f + 0.070566f * y * y) - t;
+        float slope = 1.5976f + 3 * 0.070566f * y * y;
+        y -= f / slope;
+    }
+    return y;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+
+//  ms a link may stay quiet in either direction before the client fills it
+//  with a heartbeat - what an idle link costs in airtime. Frames of any
+//  kind count, so heartbeats stay off the air while data flows.
+#ifndef NOW_HEARTBEAT_INTERVAL
+#define NOW_HEARTBEAT_INTERVAL 60000
+#endif
+
+//  suspicion at which a peer gets probed, -log10 of the chance that it is
+//  still there and only slower than usual. Higher detects later, with
+//  fewer probes of peers that were fine.
+#ifndef NOW_LIVENESS_PHI
+#define NOW_LIVENESS_PHI 8
+#endif
+
+//  ms the gaps between frames are assumed to vary by at least, so a link
+//  with clockwork traffic isn't suspected the moment a frame is late
+#ifndef NOW_LIVENESS_MIN_DEVIATION
+#define NOW_LIVENESS_MIN_DEVIATION 50
+#endif
+
+//  heartbeats sent to a suspected peer, NOW_LIVENESS_PROBE_TIMEOUT ms
+//  apart, before it is given up
+#ifndef NOW_LIVENESS_PROBES
+#define NOW_LIVENESS_PROBES 3
+#endif
+
+#ifndef NOW_LIVENESS_PROBE_TIMEOUT
+#define NOW_LIVENESS_PROBE_TIMEOUT 250
+#endif
+
+//  NOW_DT_HANDSHAKE payload - lets the server expect the client's
+//  heartbeats as often as they come
+struct __attribute__((packed)) NowLivenessInfo {
+    uint32_t heartbeatInterval;
+};
+
+//  phi accrual failure detector (Hayashibara et al.) over the gaps between
+//  frames from one peer. The gaps are tracked as a smoothed mean and mean
+//  deviation, the way TCP tracks round trips, and a silence is suspicious
+//  once a normal distribution of them makes it unlikely enough. Busy links
+//  are suspected within a few frame times, idle ones learn the heartbeat
+//  interval. Suspicion only starts probes - the peer is given up once
+//  those go unanswered too.
+class NowLiveness
+{
+public:
+    enum Verdict : uint8_t
+    {
+        Alive,          //  nothing to do until next
+        Probe,          //  send the peer a heartbeat now
+        Dead
+    };
+
+private:
+    unsigned long last = 0;
+    float mean = 0.0f;
+    float deviation = 0.0f;
+    uint8_t probes = 0;
+    bool suspected = false;
+    unsigned long probedAt = 0;
+
+public:
+    //  the peer was just heard from, and is expected about every
+    //  expected ms
+    void reset(unsigned long now, unsigned long expected);
+    //  a frame from the peer
+    void heard(unsigned long now);
+    //  proof it is there that says nothing about its traffic, like the
+    //  driver's ack for a frame we sent it
+    void alive(unsigned long now);
+    //  a frame the driver couldn't deliver - probe without waiting for
+    //  the silence to grow suspicious
+    void missed();
+    unsigned long lastHeard() const;
+    //  when the silence reaches the suspicion deviations(phi) stands for
+    unsigned long suspectAt(float deviations) const;
+    Verdict check(unsigned long now, float deviations, unsigned long &next);
+    //  standard deviations past the mean gap where phi is reached
+    static float deviations(float phi);
+};
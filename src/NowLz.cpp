@@ -0,0 +1,134 @@
+#include <string.h>
+
+#include "NowLz.h"
+
+static const int minMatch = 4;
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint32_t hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - NOW_LZ_HASH_BITS);
+}
+
+//  bytes taken by a length extension
+static inline int extension(int value)
+{
+    return (value >= 15) ? (value - 15) / 255 + 1 : 0;
+}
+
+//  writes one sequence, false when out of room
+static bool emitSequence(const uint8_t *literals, int literalCount, int offset, int matchLength,
+                         uint8_t *out, int &o, int outMax)
+{
+    int matchCode = matchLength ? matchLength - minMatch : 0;
+    int need = 1 + extension(literalCount) + literalCount;
+    if (matchLength) need += 2 + extension(matchCode);
+    if (o + need > outMax) return false;
+    uint8_t &token = out[o++];
+    token = (uint8_t)(((literalCount < 15) ? literalCount : 15) << 4);
+    if (literalCount >= 15)
+    {
+        int left = literalCount - 15;
+        for (; left >= 255; left -= 255) out[o++] = 255;
+        out[o++] = (uint8_t)left;
+    }
+    memcpy(out + o, literals, literalCount);
+    o += literalCount;
+    if (!matchLength) return true;
+
+    out[o++] = (uint8_t)offset;
+    out[o++] = (uint8_t)(offset >> 8);
+    token |= (uint8_t)((matchCode < 15) ? matchCode : 15);
+    if (matchCode >= 15)
+    {
+        int left = matchCode - 15;
+        for (; left >= 255; left -= 255) out[o++] = 255;
+        out[o++] = (uint8_t)left;
+    }
+    return true;
+}
+
+int NowLz::compress(const uint8_t *in, int length, uint8_t *out, int outMax)
+{
+    if ((length <= 0) || (length > 0xffff)) return 0;
+    memset(table, 0, sizeof(table));
+    int anchor = 0;
+    int pos = 0;
+    int o = 0;
+    while (pos + minMatch <= length)
+    {
+        uint32_t seq = read32(in + pos);
+        uint32_t h = hash(seq);
+        int candidate = table[h];
+        table[h] = (uint16_t)pos;
+        if ((candidate >= pos) || (read32(in + candidate) != seq))
+        {
+            pos++;
+            continue;
+        }
+        int matchLength = minMatch;
+        while ((pos + matchLength < length) && (in[candidate + matchLength] == in[pos + matchLength])) matchLength++;
+        if (!emitSequence(in + anchor, pos - anchor, pos - candidate, matchLength, out, o, outMax)) return 0;
+        pos += matchLength;
+        anchor = pos;
+        //  keep the table warm across the match
+        if (pos + 2 <= length) table[hash(read32(in + pos - 2))] = (uint16_t)(pos - 2);
+    }
+    if (!emitSequence(in + anchor, length - anchor, 0, 0, out, o, outMax)) return 0;
+    return o;
+}
+
+int NowLz::decompress(const uint8_t *in, int length, uint8_t *out, int outMax)
+{
+    int i = 0;
+    int o = 0;
+    while (i < length)
+    {
+        uint8_t token = in[i++];
+        int literalCount = token >> 4;
+        if (literalCount == 15)
+        {
+            uint8_t b;
+            do
+            {
+                if (i >= length) return -1;
+                b = in[i++];
+                literalCount += b;
+            } while (b == 255);
+        }
+        if ((i + literalCount > length) || (o + literalCount > outMax)) return -1;
+        memcpy(out + o, in + i, literalCount);
+        i += literalCount;
+        o += literalCount;
+        //  the last sequence ends with its literals
+        if (i == length) break;
+
+        if (i + 2 > length) return -1;
+        int offset = in[i] | (in[i + 1] << 8);
+        i += 2;
+        int matchLength = (token & 15);
+        if (matchLength == 15)
+        {
+            uint8_t b;
+            do
+            {
+                if (i >= length) return -1;
+                b = in[i++];
+                matchLength += b;
+            } while (b == 255);
+        }
+        matchLength += minMatch;
+        if ((offset == 0) || (offset > o) || (o + matchLength > outMax)) return -1;
+        //  byte by byte, a match may overlap what it produces
+        const uint8_t *from = out + o - offset;
+        for (int k = 0; k < matchLength; k++) out[o + k] = from[k];
+        o += matchLength;
+    }
+    return o;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+//  match finder size - the codec's whole working memory is 2 << bits bytes
+#ifndef NOW_LZ_HASH_BITS
+#define NOW_LZ_HASH_BITS 9
+#endif
+
+//  largest message that is compressed into a single frame, and the most a
+//  compressed frame may expand to on receive
+#ifndef NOW_COMPRESS_MAX
+#define NOW_COMPRESS_MAX 2048
+#endif
+
+//  compressed frames that can be expanded, and leased, at the same time -
+//  buffers of NOW_COMPRESS_MAX bytes apart from the reassembly ones
+#ifndef NOW_EXPAND_SLOTS
+#define NOW_EXPAND_SLOTS 2
+#endif
+
+//  shorter messages are never worth it
+#ifndef NOW_COMPRESS_MIN
+#define NOW_COMPRESS_MIN 32
+#endif
+
+//  LZ77 in the LZ4 block layout: sequences of a token (literal count,
+//  match length), literals and a 16-bit match offset. The last sequence
+//  has literals only.
+class NowLz
+{
+private:
+    uint16_t table[1 << NOW_LZ_HASH_BITS];
+
+public:
+    //  compressed length, 0 when the result would not fit outMax
+    int compress(const uint8_t *in, int length, uint8_t *out, int outMax);
+    //  decompressed length, -1 for malformed input or not fitting outMax
+    static int decompress(const uint8_t *in, int length, uint8_t *out, int outMax);
+};
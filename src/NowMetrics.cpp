@@ -0,0 +1,75 @@
+#include "NowMetrics.h"
+
+NowHistogram::NowHistogram()
+{
+    for (std::atomic<uint32_t> &bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+}
+
+void NowHistogram::record(unsigned long ms)
+{
+    int bucket = 0;
+    while ((bucket < NOW_HISTOGRAM_BUCKETS - 1) && (ms >= (1ul << bucket))) bucket++;
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add((uint32_t)ms, std::memory_order_relaxed);
+    uint32_t seen = max.load(std::memory_order_relaxed);
+    while ((ms > seen) && !max.compare_exchange_weak(seen, (uint32_t)ms, std::memory_order_relaxed))
+    {
+    }
+}
+
+void NowHistogram::read(NowHistogramSnapshot &out) const
+{
+    for (int i = 0; i < NOW_HISTOGRAM_BUCKETS; i++) out.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+    out.count = count.load(std::memory_order_relaxed);
+    out.sum = sum.load(std::memory_order_relaxed);
+    out.max = max.load(std::memory_order_relaxed);
+}
+
+uint32_t NowHistogramSnapshot::percentile(float fraction) const
+{
+    uint32_t total = 0;
+    for (int i = 0; i < NOW_HISTOGRAM_BUCKETS; i++) total += buckets[i];
+    if (total == 0) return 0;
+    uint32_t target = (uint32_t)(fraction * total + 0.5f);
+    uint32_t seen = 0;
+    for (int i = 0; i < NOW_HISTOGRAM_BUCKETS - 1; i++)
+    {
+        seen += buckets[i];
+        if (seen >= target) return 1ul << i;
+    }
+    return max;
+}
+
+NowMetrics::NowMetrics()
+{
+    for (int i = 0; i < NOW_DT_COUNT; i++)
+    {
+        sent[i].store(0, std::memory_order_relaxed);
+        received[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void NowMetrics::read(NowMetricsSnapshot &out) const
+{
+    for (int i = 0; i < NOW_DT_COUNT; i++)
+    {
+        out.sent[i] = sent[i].load(std::memory_order_relaxed);
+        out.received[i] = received[i].load(std::memory_order_relaxed);
+    }
+    out.sendErrors = sendErrors.load(std::memory_order_relaxed);
+    out.sendFailures = sendFailures.load(std::memory_order_relaxed);
+    out.rejected = rejected.load(std::memory_order_relaxed);
+    out.corrupted = corrupted.load(std::memory_order_relaxed);
+    out.droppedUnbound = droppedUnbound.load(std::memory_order_relaxed);
+    out.advertisements = advertisements.load(std::memory_order_relaxed);
+    out.channelScans = channelScans.load(std::memory_order_relaxed);
+    out.relayed = relayed.load(std::memory_order_relaxed);
+    out.relayDuplicates = relayDuplicates.load(std::memory_order_relaxed);
+    out.probes = probes.load(std::memory_order_relaxed);
+    out.binds = binds.load(std::memory_order_relaxed);
+    out.unbinds = unbinds.load(std::memory_order_relaxed);
+    heartbeatRtt.read(out.heartbeatRtt);
+    timeToBind.read(out.timeToBind);
+    oneWayLatency.read(out.oneWayLatency);
+}
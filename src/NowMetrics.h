@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+#include "NowMsg.h"
+#include "ClientTable.h"
+
+//  histogram bucket i counts values below 2^i ms (or µs, where noted), the
+//  last one the rest
+#ifndef NOW_HISTOGRAM_BUCKETS
+#define NOW_HISTOGRAM_BUCKETS 16
+#endif
+
+struct NowHistogramSnapshot
+{
+    uint32_t buckets[NOW_HISTOGRAM_BUCKETS];
+    uint32_t count;
+    uint32_t sum;
+    uint32_t max;
+
+    //  upper bound of the bucket holding the given fraction of samples
+    uint32_t percentile(float fraction) const;
+};
+
+//  fixed-bucket histogram, recording is a few relaxed atomic adds
+class NowHistogram
+{
+private:
+    std::atomic<uint32_t> buckets[NOW_HISTOGRAM_BUCKETS];
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint32_t> sum{0};
+    std::atomic<uint32_t> max{0};
+
+public:
+    NowHistogram();
+    void record(unsigned long ms);
+    void read(NowHistogramSnapshot &out) const;
+};
+
+struct NowPeerSeen
+{
+    uint8_t mac[6];
+    unsigned long lastSeen;
+};
+
+//  a copy of the counters at one point in time
+struct NowMetricsSnapshot
+{
+    unsigned long now;
+    uint32_t sent[NOW_DT_COUNT];
+    uint32_t received[NOW_DT_COUNT];
+    uint32_t sendErrors;        //  refused by the driver
+    uint32_t sendFailures;      //  reported failed by the send callback
+    uint32_t rejected;          //  not ours - size, version, magic or datatype
+    uint32_t corrupted;         //  ours but failed the CRC
+    uint32_t droppedUnbound;    //  from peers we are not bound to
+    uint32_t rxOverruns;
+    uint32_t advertisements;
+    uint32_t channelScans;      //  sweeps over every channel
+    uint32_t relayed;           //  frames passed on for other nodes
+    uint32_t relayDuplicates;   //  relayed broadcasts that came in again
+    uint32_t probes;            //  heartbeats to a suspected peer
+    uint32_t binds;
+    uint32_t unbinds;
+    uint32_t retransmits;
+    uint32_t reliableFailures;
+    uint32_t reassemblyExpired;
+    uint32_t reassemblyDropped;
+    uint32_t peerRegistrations; //  driver peer table adds
+    uint32_t peerEvictions;     //  of those, made room by dropping another
+    int txQueued;               //  frames waiting in the send queue
+    int rxQueued;               //  frames waiting for the worker or leased
+    NowHistogramSnapshot heartbeatRtt;
+    NowHistogramSnapshot timeToBind;
+    NowHistogramSnapshot oneWayLatency;     //  µs
+    int32_t clockOffset;        //  µs the server's clock is ahead of ours
+    float clockDrift;           //  ppm
+    uint32_t clockDelay;        //  fastest sync round trip, µs
+    int peerCount;
+    NowPeerSeen peers[NOW_MAX_CLIENTS];
+};
+
+//  live counters - relaxed atomics, cheap enough to leave on
+struct NowMetrics
+{
+    std::atomic<uint32_t> sent[NOW_DT_COUNT];
+    std::atomic<uint32_t> received[NOW_DT_COUNT];
+    std::atomic<uint32_t> sendErrors{0};
+    std::atomic<uint32_t> sendFailures{0};
+    std::atomic<uint32_t> rejected{0};
+    std::atomic<uint32_t> corrupted{0};
+    std::atomic<uint32_t> droppedUnbound{0};
+    std::atomic<uint32_t> advertisements{0};
+    std::atomic<uint32_t> channelScans{0};
+    std::atomic<uint32_t> relayed{0};
+    std::atomic<uint32_t> relayDuplicates{0};
+    std::atomic<uint32_t> probes{0};
+    std::atomic<uint32_t> binds{0};
+    std::atomic<uint32_t> unbinds{0};
+    NowHistogram heartbeatRtt;
+    NowHistogram timeToBind;
+    NowHistogram oneWayLatency;     //  µs, frames with synced timestamps
+
+    NowMetrics();
+    static void count(std::atomic<uint32_t> &counter)
+    {
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+    void read(NowMetricsSnapshot &out) const;
+};
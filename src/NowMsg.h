@@ -1,51 +1,162 @@
 // NowMsg.h
 #pragma once
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 
+#include "NowCrc.h"
+
 static const size_t ESPNOW_MAX_DATA = 250;  // conservative app-layer limit
 
-enum : uint16_t {
+// Wire version. Legacy nodes sent a uint16_t datatype whose high byte is
+// always 0, which is where the version now lives - so legacy frames read
+// as version 0 and legacy nodes see unknown datatypes from us.
+static const uint8_t NOW_WIRE_LEGACY  = 0;
+static const uint8_t NOW_WIRE_VERSION = 4;
+// Follows the version, so other ESP-NOW traffic is told apart in two bytes
+static const uint8_t NOW_WIRE_MAGIC   = 0xe5;
+
+// Legacy frames carry neither magic nor CRC, so any 250-byte frame can
+// pass for one. Define as 1 while legacy nodes are still on the network.
+#ifndef NOW_ACCEPT_LEGACY
+#define NOW_ACCEPT_LEGACY 0
+#endif
+
+enum : uint8_t {
   NOW_DT_ADVERTISE  = 0,
   NOW_DT_CONNECT    = 1,
   NOW_DT_HANDSHAKE  = 2,
   NOW_DT_ACK        = 3,
   NOW_DT_HEARTBEAT  = 4,
-  NOW_DT_DATA       = 5
+  NOW_DT_DATA       = 5,
+  NOW_DT_FRAGMENT   = 6,
+  NOW_DT_DATA_ACK   = 7,
+  NOW_DT_SOLICIT    = 8,   // server broadcast, unbound clients advertise now
+  NOW_DT_GROUP      = 9,   // server broadcast to a set of clients, see NowGroup.h
+  NOW_DT_GROUP_ACK  = 10,
+  NOW_DT_BEACON     = 11,  // server broadcast, the TDMA superframe, see NowTdma.h
+  NOW_DT_COUNT           // one past the last datatype, sizes dispatch tables
+};
+
+// NowMsg::flags
+enum : uint8_t {
+  NOW_FLAG_RELIABLE = 0x01,  // seq is valid, receiver answers with NOW_DT_DATA_ACK
+  NOW_FLAG_BATCH    = 0x02,  // NOW_DT_DATA payload holds several messages, see NowBatch.h
+  NOW_FLAG_COMPRESSED = 0x04,// NOW_DT_DATA payload is NowLz compressed, applied after batching
+  NOW_FLAG_TOPIC    = 0x08,  // every message in the frame starts with a topic id, see NowTopic.h
+  NOW_FLAG_RELAY    = 0x10,  // NOW_DT_ADVERTISE relays pass on, NOW_DT_SOLICIT from a relay asking for those
+  NOW_FLAG_SYNCED   = 0x20   // timestamp is on the server's clock, see NowClock.h
 };
 
 struct __attribute__((packed)) NowMsg {
-  uint32_t timestamp;   // millis()
-  uint16_t datatype;    // values above
+  uint32_t timestamp;   // sender's micros() when it went out, set by transmitMsg
+  uint8_t  datatype;    // values above
+  uint8_t  version;     // NOW_WIRE_VERSION
+  uint8_t  magic;       // NOW_WIRE_MAGIC
   uint8_t  fromMac[6];
   uint8_t  toMac[6];
   uint16_t length;      // bytes valid in payload
-  uint8_t  payload[230];// 250 - 20-byte header = 230
+  uint8_t  flags;       // NOW_FLAG_*
+  uint16_t seq;         // per-peer sequence for reliable frames
+  uint8_t  hops;        // relays passed so far, fromMac is where the frame started
+  uint16_t crc;         // nowCrc16 over the header before it and the valid payload
+  uint8_t  payload[223];// 250 - 27-byte header = 223
 };
 
 static_assert(sizeof(NowMsg) == 250, "NowMsg must be exactly 250 bytes");
 
+static const size_t NOW_MSG_HEADER  = offsetof(NowMsg, payload);  // 27
+static const size_t NOW_MAX_PAYLOAD = sizeof(NowMsg::payload);
+
+// Legacy frame layout, only used to decode frames from version 0 nodes
+struct __attribute__((packed)) NowMsgLegacy {
+  uint32_t timestamp;
+  uint16_t datatype;
+  uint8_t  fromMac[6];
+  uint8_t  toMac[6];
+  uint16_t length;
+  uint8_t  payload[230];
+};
+
+static_assert(sizeof(NowMsgLegacy) == 250, "NowMsgLegacy must be exactly 250 bytes");
+
+// Only the header and the valid payload bytes go on the air
+inline int msgSize(const NowMsg& m) { return (int)(NOW_MSG_HEADER + m.length); }
+
 inline void copyMac(uint8_t dst[6], const uint8_t src[6]) { memcpy(dst, src, 6); }
 
 inline bool buildMsg(NowMsg& m,
-                     uint16_t datatype,
+                     uint8_t datatype,
                      const uint8_t fromMac[6],
                      const uint8_t toMac[6],
                      const void* buf,
-                     uint16_t len,
-                     uint32_t nowMillis) {
+                     uint16_t len) {
   if (len > sizeof(m.payload)) return false;
-  m.timestamp = nowMillis;
+  m.timestamp = 0;
   m.datatype  = datatype;
+  m.version   = NOW_WIRE_VERSION;
+  m.magic     = NOW_WIRE_MAGIC;
   copyMac(m.fromMac, fromMac);
   copyMac(m.toMac,   toMac);
   m.length = len;
+  m.flags  = 0;
+  m.seq    = 0;
+  m.hops   = 0;
+  m.crc    = 0;
   if (len) memcpy(m.payload, buf, len);
   return true;
 }
 
+inline uint16_t msgCrc(const NowMsg& m) {
+  uint16_t crc = nowCrc16(0, reinterpret_cast<const uint8_t*>(&m), offsetof(NowMsg, crc));
+  return nowCrc16(crc, m.payload, m.length);
+}
+
+// Last thing before the frame goes to the radio, after flags and seq are set
+inline void sealMsg(NowMsg& m) { m.crc = msgCrc(m); }
+
+enum NowFrameCheck : uint8_t {
+  NOW_FRAME_OK      = 0,
+  NOW_FRAME_FOREIGN = 1,   // not ours - wrong size, version or magic
+  NOW_FRAME_CORRUPT = 2    // ours, but the CRC doesn't match
+};
+
+// Cheapest tests first: size, then version and magic, then the CRC
+inline NowFrameCheck checkMsg(const uint8_t* data, int rxLen) {
+  if (rxLen < (int)NOW_MSG_HEADER || rxLen > (int)sizeof(NowMsg)) return NOW_FRAME_FOREIGN;
+  const NowMsg* m = reinterpret_cast<const NowMsg*>(data);
+  if (m->version == NOW_WIRE_VERSION && m->magic == NOW_WIRE_MAGIC) {
+    if (rxLen != msgSize(*m)) return NOW_FRAME_FOREIGN;
+    return (m->crc == msgCrc(*m)) ? NOW_FRAME_OK : NOW_FRAME_CORRUPT;
+  }
+#if NOW_ACCEPT_LEGACY
+  // legacy nodes always transmit the full 250 bytes, and only knew the
+  // datatypes up to NOW_DT_DATA
+  if (m->version == NOW_WIRE_LEGACY) {
+    const NowMsgLegacy* l = reinterpret_cast<const NowMsgLegacy*>(data);
+    if (rxLen == (int)sizeof(NowMsgLegacy) && l->datatype <= NOW_DT_DATA && l->length <= sizeof(l->payload))
+      return NOW_FRAME_OK;
+  }
+#endif
+  return NOW_FRAME_FOREIGN;
+}
+
 inline bool validateMsg(const uint8_t* data, int rxLen) {
-  if (rxLen != (int)sizeof(NowMsg)) return false;
+  return checkMsg(data, rxLen) == NOW_FRAME_OK;
+}
+
+// Validates a received frame and returns it in the current layout, legacy
+// frames are converted into scratch. nullptr if the frame is invalid, with
+// the reason in check.
+inline const NowMsg* decodeMsg(const uint8_t* data, int rxLen, NowMsg& scratch, NowFrameCheck* check = nullptr) {
+  NowFrameCheck result = checkMsg(data, rxLen);
+  if (check) *check = result;
+  if (result != NOW_FRAME_OK) return nullptr;
   const NowMsg* m = reinterpret_cast<const NowMsg*>(data);
-  return (m->length <= sizeof(m->payload));
+  if (m->version != NOW_WIRE_LEGACY) return m;
+  const NowMsgLegacy* l = reinterpret_cast<const NowMsgLegacy*>(data);
+  // its timestamp is the sender's millis(), not comparable, so it is dropped
+  if (!buildMsg(scratch, (uint8_t)l->datatype, l->fromMac, l->toMac, l->payload, l->length)) return nullptr;
+  scratch.version = NOW_WIRE_LEGACY;
+  return &scratch;
 }
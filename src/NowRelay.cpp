@@ -0,0 +1,85 @@
+#include <Helpers.h>
+#include "NowRelay.h"
+
+void RelayTable::clear()
+{
+    used = 0;
+    memset(seenRing, 0, sizeof(seenRing));
+    seenNext = 0;
+}
+
+int RelayTable::find(uint64_t dest) const
+{
+    for (int i = 0; i < used; i++)
+    {
+        if (routes[i].dest == dest) return i;
+    }
+    return -1;
+}
+
+bool RelayTable::nextHop(const uint8_t *dest, uint8_t *via) const
+{
+    if (!used) return false;
+    int i = find(Helpers::macToKey(dest));
+    if (i < 0) return false;
+    Helpers::keyToMac(routes[i].via, via);
+    return true;
+}
+
+void RelayTable::learn(const uint8_t *origin, const uint8_t *via, uint8_t hops, unsigned long now)
+{
+    uint64_t dest = Helpers::macToKey(origin);
+    uint64_t link = Helpers::macToKey(via);
+    int i = find(dest);
+    //  heard directly - nothing beats that
+    if (dest == link)
+    {
+        if (i >= 0) routes[i] = routes[--used];
+        return;
+    }
+    if (i < 0)
+    {
+        if (used >= NOW_RELAY_ROUTES) return;
+        routes[used++] = {dest, link, hops, 0, now};
+        return;
+    }
+    Route &route = routes[i];
+    bool stale = (route.failures >= NOW_RELAY_MAX_FAILURES) || (now - route.learnedAt > NOW_RELAY_ROUTE_HOLD);
+    if ((route.via != link) && (hops >= route.hops) && !stale) return;
+    route = {dest, link, hops, route.via == link ? route.failures : (uint8_t)0, now};
+}
+
+void RelayTable::linkResult(const uint8_t *via, bool success)
+{
+    uint64_t link = Helpers::macToKey(via);
+    for (int i = 0; i < used; i++)
+    {
+        Route &route = routes[i];
+        if (route.via != link) continue;
+        if (success) route.failures = 0;
+        else if (route.failures < 255) route.failures++;
+    }
+}
+
+void RelayTable::forget(const uint8_t *dest)
+{
+    int i = find(Helpers::macToKey(dest));
+    if (i >= 0) routes[i] = routes[--used];
+}
+
+int RelayTable::count() const
+{
+    return used;
+}
+
+bool RelayTable::seen(const NowMsg &m)
+{
+    uint64_t origin = Helpers::macToKey(m.fromMac);
+    for (const Seen &s : seenRing)
+    {
+        if ((s.origin == origin) && (s.timestamp == m.timestamp) && (s.datatype == m.datatype)) return true;
+    }
+    seenRing[seenNext] = {origin, m.timestamp, m.datatype};
+    seenNext = (seenNext + 1) % NOW_RELAY_SEEN;
+    return false;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "NowMsg.h"
+#include "ClientTable.h"
+
+//  relays a frame may pass on its way
+#ifndef NOW_RELAY_MAX_HOPS
+#define NOW_RELAY_MAX_HOPS 4
+#endif
+
+//  destinations reached through a relay
+#ifndef NOW_RELAY_ROUTES
+#define NOW_RELAY_ROUTES NOW_MAX_CLIENTS
+#endif
+
+//  recent relayed broadcasts remembered to drop the copies that come in
+//  over other relays
+#ifndef NOW_RELAY_SEEN
+#define NOW_RELAY_SEEN 32
+#endif
+
+//  a route no frame came back over for this long gives way to any other
+#ifndef NOW_RELAY_ROUTE_HOLD
+#define NOW_RELAY_ROUTE_HOLD 1000
+#endif
+
+//  unacknowledged sends in a row before a route gives way to any other
+#ifndef NOW_RELAY_MAX_FAILURES
+#define NOW_RELAY_MAX_FAILURES 3
+#endif
+
+//  next hops towards nodes we don't hear directly, learned from the link
+//  each relayed frame arrived over. Fewest hops wins, and a route that
+//  stopped working - no frames back, or sends going unacknowledged -
+//  yields to whatever path shows up next.
+class RelayTable
+{
+private:
+    struct Route
+    {
+        uint64_t dest;
+        uint64_t via;
+        uint8_t hops;
+        uint8_t failures;
+        unsigned long learnedAt;
+    };
+    struct Seen
+    {
+        uint64_t origin;
+        uint32_t timestamp;
+        uint8_t datatype;
+    };
+
+    Route routes[NOW_RELAY_ROUTES];
+    int used = 0;
+    Seen seenRing[NOW_RELAY_SEEN] = {};
+    int seenNext = 0;
+
+    int find(uint64_t dest) const;
+
+public:
+    void clear();
+    //  where a frame to dest goes, false when it goes straight there
+    bool nextHop(const uint8_t *dest, uint8_t *via) const;
+    //  a frame from origin arrived over the link from via after hops relays
+    void learn(const uint8_t *origin, const uint8_t *via, uint8_t hops, unsigned long now);
+    //  the send callback for a frame handed to via
+    void linkResult(const uint8_t *via, bool success);
+    void forget(const uint8_t *dest);
+    int count() const;
+    //  true for a broadcast already seen, remembering it otherwise
+    bool seen(const NowMsg &m);
+};
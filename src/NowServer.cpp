@@ -1,10 +1,9 @@
 #include <Helpers.h>
-#include "esp_now.h"
-
 #include "NowServer.h"
 #include "NowDebug.h"
 
-NowServer::NowServer()
+NowServer::NowServer(NowTransport *transport)
+    : NowService(transport)
 {
     role = ServiceRole::Server;
 }
@@ -13,181 +12,514 @@ NowServer::~NowServer()
 {
 }
 
-void NowServer::work(unsigned long now, unsigned long ticks)
+void NowServer::checkClient(int slot, unsigned long now)
 {
     //  make sure we can let idle clients go
-    if (boundMac && !Helpers::macIsEmpty(boundMac, sizeof(boundMac)))
+    ClientData *client = clients.at(slot);
+    if (!client) return;
+    unsigned long next;
+    NowLiveness::Verdict verdict = client->liveness.check(now, suspectDeviations, next);
+    if (verdict == NowLiveness::Alive)
+    {
+        //  seen since the timer was armed
+        timers.arm(clientTimers[slot], next);
+        return;
+    }
+    //  quieter than its traffic so far makes likely - ask, unless it never
+    //  finished binding
+    if ((verdict == NowLiveness::Probe) && (client->state == CLIENT_DATA_CONFIRM))
     {
-        unsigned long elapsed = now - clientLast;
-        if (elapsed < clientTimeout) return;
-        //  get our selected client data
-        ClientData client;
-        getClient(boundMac, client);
-        //  client hasn't sent a heartbeat - unbind
-        Helpers::unsetFlag(Bound, serviceMode);
-        client.state = CLIENT_DATA_NEW;
-        memset(boundMac, 0x0, 6);
+        printDebug("(checkClient) Probing client: " + Helpers::macToString(client->mac), 0);
+        NowMetrics::count(counters.probes);
+        sendHeartbeat(client->mac);
+        timers.arm(clientTimers[slot], next);
+        return;
     }
+    //  client hasn't answered - unbind
+    printDebug("(checkClient) Client timed out: " + Helpers::macToString(client->mac), 0);
+    removeClient(client);
 }
 
 void NowServer::dataReceived(const uint8_t *mac, const uint8_t *incomingData, int len)
 {
     printDebug("(dataReceived) Received data from: " + Helpers::macToString(mac) + ", length: " + String(len), 0);
-    String myMac = Helpers::macToString(macAddress);
     //  check that we didn't receive our own data
     if (Helpers::macEquals(macAddress, mac))
     {
-        printDebug("*** (dataReceived) We received our own data - " + myMac + ", " + Helpers::macToString(mac), 0);
+        printDebug("*** (dataReceived) We received our own data - " + Helpers::macToString(macAddress) + ", " + Helpers::macToString(mac), 0);
         return;
     }
 
     //  deserialize incoming data
-    if (!validateMsg(incomingData, len))
-        return;
-    const NowMsg *m = reinterpret_cast<const NowMsg *>(incomingData);
+    NowMsg scratch;
+    const NowMsg *m = decodeFrame(mac, incomingData, len, scratch);
+    if (!m) return;
+    ClientData *client = clients.find(m->fromMac);
+    unsigned long now = transport->millis();
 
-    //  TODO: do this better that with a long switch - declaritively - how in c++?
-    uint16_t replyType = 0;
-    if (m->datatype == NOW_DT_ADVERTISE)
+    const Route &route = routes[m->datatype];
+    if (!route.handler) return;
+    if (route.bound)
     {
-        printDebug("    (dataReceived-0) Client advertisement received.", 1);
-        if (boundMac && !Helpers::macIsEmpty(boundMac, sizeof(boundMac)))
-        {
-            printDebug("    (dataReceived-0) Already bound to a client. Ignore.", 1);
-            return;
-        }
-        // name came in payload (not NUL-terminated). Copy safely:
-        char nameBuf[231];
-        uint16_t n = m->length;
-        if (n > 230)
-            n = 230;
-        memcpy(nameBuf, m->payload, n);
-        nameBuf[n] = '\0';
-        addClient(String(nameBuf), Helpers::macToString(m->fromMac), CLIENT_DATA_NEW);
-        //  send connect data
-        replyType = NOW_DT_CONNECT;
-    }
-    else if (m->datatype == NOW_DT_HANDSHAKE)
-    {
-        printDebug("    (dataReceived-2) Client handshake received.", 1);
-        if (boundMac && !Helpers::macIsEmpty(boundMac, sizeof(boundMac)) && !Helpers::macEquals(m->fromMac, boundMac))
+        //  make sure the frame is from a bound client
+        if (!client || (client->state != CLIENT_DATA_CONFIRM))
         {
-            printDebug("    (dataReceived-2) Already bound to a client (" + Helpers::macToString(boundMac) + "). Ignore (" + Helpers::macToString(m->fromMac) + ")", 1);
+            printDebug("    (dataReceived-" + String(m->datatype) + ") Incoming frame from unbound client. Ignore, client will reset to advertise.", 1);
+            NowMetrics::count(counters.droppedUnbound);
             return;
         }
-        clientLast = millis();
-        //  update the client data
-        addClient("", Helpers::macToString(m->fromMac), CLIENT_DATA_CONFIRM);
-        replyType = NOW_DT_ACK;
-        //  we're bound now
-        Helpers::setFlag(Bound, serviceMode);
-        if (onPeerBound) onPeerBound(Helpers::macToString(boundMac));
-    }
-    else if (m->datatype == NOW_DT_HEARTBEAT)
-    {
-        //  make sure the heartbeat is from our bound client
-        if (!boundMac || Helpers::macIsEmpty(boundMac, sizeof(boundMac)))
-        {
-            printDebug("    (dataReceived-4) Not bound to a client. Ignore.", 1);
-            return;
-        }
-        if (!Helpers::macEquals(boundMac, m->fromMac))
-        {
-            printDebug("    (dataReceived-4) Heartbeat request received from unbound client. Ignore, client will reset to advertise.", 1);
-            return;
-        }
-        clientLast = millis();
-        printDebug("    (dataReceived-4) Client heartbeat request.", 1);
-        sendHeartbeat(m->fromMac);
+        client->liveness.heard(now);
+    }
+    (this->*route.handler)(m, client, now);
+}
+
+//  what the server does with each datatype - bound routes only accept
+//  frames from bound clients
+const NowServer::Route NowServer::routes[NOW_DT_COUNT] = {
+    {&NowServer::advertiseReceived, false},     //  NOW_DT_ADVERTISE
+    {nullptr, false},                           //  NOW_DT_CONNECT
+    {&NowServer::handshakeReceived, false},     //  NOW_DT_HANDSHAKE
+    {nullptr, false},                           //  NOW_DT_ACK
+    {&NowServer::heartbeatReceived, true},      //  NOW_DT_HEARTBEAT
+    {&NowServer::dataFrameReceived, true},      //  NOW_DT_DATA
+    {&NowServer::fragmentFrameReceived, true},  //  NOW_DT_FRAGMENT
+    {&NowServer::dataAckFrameReceived, true},   //  NOW_DT_DATA_ACK
+    {nullptr, false},                           //  NOW_DT_SOLICIT
+    {nullptr, false},                           //  NOW_DT_GROUP
+    {&NowServer::groupAckReceived, true},       //  NOW_DT_GROUP_ACK
+    {nullptr, false},                           //  NOW_DT_BEACON
+};
+
+void NowServer::advertiseReceived(const NowMsg *m, ClientData *client, unsigned long now)
+{
+    printDebug("    (dataReceived-0) Client advertisement received.", 1);
+    // name came in payload (not NUL-terminated). Copy safely:
+    char nameBuf[NOW_MAX_PAYLOAD + 1];
+    uint16_t n = m->length;
+    if (n > NOW_MAX_PAYLOAD)
+        n = NOW_MAX_PAYLOAD;
+    memcpy(nameBuf, m->payload, n);
+    nameBuf[n] = '\0';
+    //  a bound client advertising again has lost us - start over
+    bool attempt = !client || (client->state == CLIENT_DATA_CONFIRM);
+    if (client && (client->state == CLIENT_DATA_CONFIRM))
+    {
+        printDebug("    (dataReceived-0) Bound client is advertising again. Rebinding.", 1);
+        NowMetrics::count(counters.unbinds);
+        client->state = CLIENT_DATA_NEW;
+        forgetPeer(client->mac);
+        updateBound();
+    }
+    client = addClient(String(nameBuf), m->fromMac);
+    if (!client) return;
+    if (attempt)
+    {
+        client->advertisedAt = now;
+        client->liveness.reset(now, heartbeatInterval);
+    }
+    else client->liveness.heard(now);
+    //  send connect data
+    reply(m, NOW_DT_CONNECT, now);
+}
+
+void NowServer::handshakeReceived(const NowMsg *m, ClientData *client, unsigned long now)
+{
+    printDebug("    (dataReceived-2) Client handshake received.", 1);
+    if (!client)
+    {
+        printDebug("    (dataReceived-2) Handshake from unknown client (" + Helpers::macToString(m->fromMac) + "). Ignore.", 1);
         return;
     }
-    else if (m->datatype == NOW_DT_DATA)
+    if (client->state != CLIENT_DATA_CONFIRM)
     {
-        //  make sure the heartbeat is from our bound client
-        if (!boundMac || Helpers::macIsEmpty(boundMac, sizeof(boundMac)))
-        {
-            printDebug("    (dataReceived-5) Not bound to a client. Ignore.", 1);
-            return;
-        }
-        if (!Helpers::macEquals(boundMac, m->fromMac))
+        //  we're bound now, expecting to hear from it as often as it says
+        NowLivenessInfo announced;
+        announced.heartbeatInterval = heartbeatInterval;
+        if (m->length >= sizeof(announced)) memcpy(&announced, m->payload, sizeof(announced));
+        client->liveness.reset(now, announced.heartbeatInterval ? announced.heartbeatInterval : heartbeatInterval);
+        client->state = CLIENT_DATA_CONFIRM;
+        client->link.reset();
+        addSourceMac(client->mac);
+        Helpers::parseMac(client->mac, boundMac);
+        updateBound();
+        nowLog(NOW_LOG_BOUND, client->key, 0, 0);
+        NowMetrics::count(counters.binds);
+        counters.timeToBind.record(now - client->advertisedAt);
+        if (onPeerBound) onPeerBound(Helpers::macToString(client->mac));
+    }
+    else client->liveness.heard(now);
+    //  the client finds itself in group bitmaps by its slot
+    NowBindInfo info;
+    info.slot = (uint8_t)clients.slotOf(client);
+    reply(m, NOW_DT_ACK, now, &info, sizeof(info));
+}
+
+void NowServer::heartbeatReceived(const NowMsg *m, ClientData *client, unsigned long now)
+{
+    //  older clients send it empty
+    NowClockSync sync{};
+    if (m->length >= sizeof(sync)) memcpy(&sync, m->payload, sizeof(sync));
+    //  the answer to our probe needs none
+    if (sync.origin) return;
+    printDebug("    (dataReceived-4) Client heartbeat request.", 1);
+    sendHeartbeat(m->fromMac, &sync);
+}
+
+void NowServer::dataFrameReceived(const NowMsg *m, ClientData *client, unsigned long now)
+{
+    if (!reliableReceived(client->mac, m, &client->link)) return;
+    deliverFrame(client->mac, m);
+}
+
+void NowServer::fragmentFrameReceived(const NowMsg *m, ClientData *client, unsigned long now)
+{
+    if (!reliableReceived(client->mac, m, &client->link)) return;
+    fragmentReceived(client->mac, m);
+}
+
+void NowServer::dataAckFrameReceived(const NowMsg *m, ClientData *client, unsigned long now)
+{
+    dataAckReceived(client->mac, m, &client->link);
+}
+
+void NowServer::groupAckReceived(const NowMsg *m, ClientData *client, unsigned long now)
+{
+    if (m->length < sizeof(NowGroupAck)) return;
+    NowGroupAck ack;
+    memcpy(&ack, m->payload, sizeof(ack));
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    for (GroupSend &send : groupSends)
+    {
+        if (!send.used || (send.msgId != ack.msgId)) continue;
+        send.acked.set(clients.slotOf(client));
+        //  sent to a group id, nobody knows who is in it - the ack
+        //  timeout settles the send with what came in by then
+        if (!send.recipients.length()) return;
+        for (int i = 0; i < NOW_GROUP_BITMAP; i++)
         {
-            printDebug("    (dataReceived-5) Incoming data from unbound client. Ignore.", 1);
-            return;
+            if (send.recipients.bits[i] & ~send.acked.bits[i]) return;
         }
-        clientLast = millis();
-        //  make received data available to the consumer
-        uint16_t n = m->length;
-        if (!onDataReceived || (n == 0) || (n > sizeof(m->payload))) return;
-        uint8_t *copy = static_cast<uint8_t *>(malloc(n));
-        if (!copy) return;
-        memcpy(copy, m->payload, n);
-        onDataReceived(copy, static_cast<int>(n));
-        free(copy);
+        finishGroup(send);
         return;
     }
-    //  TODO: refactor this
-    //  send response
+}
+
+void NowServer::reply(const NowMsg *m, uint8_t datatype, unsigned long now, const void *payload, uint16_t length)
+{
     NowMsg out{};
-    if (buildMsg(out, replyType, macAddress, m->fromMac, nullptr, 0, millis()))
+    if (buildMsg(out, datatype, macAddress, m->fromMac, payload, length))
     {
-        sendMsg(mac, out);
+        sendMsg(m->fromMac, out);
     }
 }
 
 void NowServer::initialize()
 {
     memset(boundMac, 0x0, 6);
-    clientLast = 0;
+    {
+        std::lock_guard<std::recursive_mutex> lock(txLock);
+        clients.clear();
+    }
+    //  clients sync their clocks to ours
+    clock.setReference();
+    for (int i = 0; i < clients.capacity(); i++)
+    {
+        clientTimers[i] = timers.add([this, i](unsigned long now) { checkClient(i, now); });
+    }
+    beaconTimer = timers.add([this](unsigned long now) { sendBeacon(now); });
+    if (tdmaSlot.load(std::memory_order_relaxed)) timers.arm(beaconTimer, transport->millis());
+    //  clients that lost us while we were gone can come back right away
+    if (solicitWindow) solicit();
     printDebug("(initialize) Server Ready!", 0);
 }
 
-void NowServer::addClient(String name, String address, int state)
+ClientData *NowServer::addClient(String name, const uint8_t *mac)
+{
+    printDebug("(addClient) Preparing to add client: " + name + ", " + Helpers::macToString(mac), 0);
+    bool created = false;
+    ClientData *client;
+    {
+        //  peerMetrics() walks the table from other tasks
+        std::lock_guard<std::recursive_mutex> lock(txLock);
+        client = clients.insert(mac, created);
+    }
+    if (!client)
+    {
+        printDebug("    (addClient) Client table is full. Ignore.", 1);
+        return nullptr;
+    }
+    if (!created)
+    {
+        printDebug("    (addClient) Known client: " + Helpers::macToString(mac), 1);
+        if (!name.isEmpty()) client->name = name;
+        return client;
+    }
+    //  the driver learns about the client when we first reply
+    client->name = name;
+    timers.arm(clientTimers[clients.slotOf(client)], transport->millis() + heartbeatInterval);
+    return client;
+}
+
+void NowServer::removeClient(ClientData *client)
 {
-    ("(addClient) Preparing to add client: " + name + ", " + address, 0);
-    //  add client as source - duplicates won't be added
     uint8_t mac[6];
-    Helpers::parseMac(address, mac);
-    addSourceMac((uint8_t *)mac);
-    //  don't add duplicates
-    for (ClientData &client : clients)
+    Helpers::parseMac(client->mac, mac);
+    nowLog(NOW_LOG_UNBOUND, client->key, 0, 0);
+    if (client->state == CLIENT_DATA_CONFIRM) NowMetrics::count(counters.unbinds);
+    forgetPeer(client->mac);
+    forgetRoute(client->mac);
+    timers.cancel(clientTimers[clients.slotOf(client)]);
     {
-        if (client.macAddress == address)
+        std::lock_guard<std::recursive_mutex> lock(txLock);
+        clients.remove(client->key);
+    }
+    removeSourceMac(mac);
+    if (Helpers::macEquals(mac, boundMac)) memset(boundMac, 0x0, 6);
+    updateBound();
+}
+
+void NowServer::updateBound()
+{
+    //  we're bound while at least one client is
+    for (int i = 0; i < clients.capacity(); i++)
+    {
+        ClientData *client = clients.at(i);
+        if (client && (client->state == CLIENT_DATA_CONFIRM))
         {
-            if (client.state == state)
-            {
-                printDebug("    (addClient) Duplicate client received: " + address, 1);
-                return;
-            }
-            else
-            {
-                printDebug("    (addClient) Updating client state: " + String(state) + " (" + String(client.state) + ")", 1);
-                client.state = state;
-                return;
-            }
+            Helpers::setFlag(Bound, serviceMode);
+            return;
         }
     }
-    //  add to the list
-    if (name.isEmpty())
+    if (Helpers::flagIsSet(Bound, serviceMode)) Helpers::unsetFlag(Bound, serviceMode);
+}
+
+PeerLink *NowServer::peerLink(const uint8_t *mac)
+{
+    ClientData *client = clients.find(mac);
+    if (!client || (client->state != CLIENT_DATA_CONFIRM)) return nullptr;
+    return &client->link;
+}
+
+void NowServer::peerMetrics(NowMetricsSnapshot &out)
+{
+    //  the worker adds and removes clients under the same lock
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    for (int i = 0; (i < clients.capacity()) && (out.peerCount < NOW_MAX_CLIENTS); i++)
     {
-        printDebug("    (addClient) Unable to add client without name.", 1);
-        return;
+        ClientData *client = clients.at(i);
+        if (!client) continue;
+        NowPeerSeen &peer = out.peers[out.peerCount++];
+        memcpy(peer.mac, client->mac, 6);
+        peer.lastSeen = client->liveness.lastHeard();
+    }
+}
+
+void NowServer::setSolicitWindow(uint16_t window)
+{
+    solicitWindow = window;
+}
+
+void NowServer::solicit()
+{
+    sendSolicit(solicitWindow);
+}
+
+void NowServer::setTdma(uint16_t slotLength)
+{
+    tdmaSlot.store(slotLength, std::memory_order_relaxed);
+    //  the timers are the worker's, it starts or stops the beacons
+    tdmaChanged.store(true, std::memory_order_relaxed);
+    if (transport) transport->wake();
+}
+
+void NowServer::sendBeacon(unsigned long now)
+{
+    uint16_t slotLength = tdmaSlot.load(std::memory_order_relaxed);
+    if (!slotLength) return;
+    NowTdmaBeacon beacon;
+    beacon.downlink = NOW_TDMA_DOWNLINK;
+    beacon.contention = NOW_TDMA_CONTENTION;
+    beacon.slotLength = slotLength;
+    //  slots up to the highest a bound client has, the next beacon
+    //  makes room for clients binding meanwhile
+    int slots = 0;
+    for (int i = 0; i < clients.capacity(); i++)
+    {
+        ClientData *client = clients.at(i);
+        if (client && (client->state == CLIENT_DATA_CONFIRM)) slots = i + 1;
+    }
+    beacon.slots = (uint8_t)slots;
+    NowMsg out{};
+    if (!buildMsg(out, NOW_DT_BEACON, macAddress, broadcastMac, &beacon, sizeof(beacon))) return;
+    {
+        std::lock_guard<std::recursive_mutex> lock(txLock);
+        tdma.start((uint32_t)transport->micros(), beacon);
     }
-    ClientData client(name, address, state);
-    clients.push_back(client);
-    Helpers::parseMac(mac, boundMac);
+    sendMsg(broadcastMac, out);
+    timers.arm(beaconTimer, now + tdma.superframe() / 1000);
 }
 
-void NowServer::getClient(const uint8_t *mac, ClientData &outClient)
+uint32_t NowServer::slotWait(uint8_t datatype, uint32_t nowUs)
 {
-    if (clients.size() == 0) return;
-    for (ClientData &client : clients)
+    //  queued data waits for the downlink, replies don't queue
+    return tdma.active(nowUs) ? tdma.wait(nowUs, NowTdma::Downlink) : 0;
+}
+
+//  until the last recipient had its turn to acknowledge, and a bit
+static unsigned long ackWait(const NowRecipients &recipients)
+{
+    int turns = recipients.length() ? recipients.count() : NOW_MAX_CLIENTS;
+    return NOW_GROUP_ACK_TIMEOUT + (unsigned long)turns * NOW_GROUP_ACK_SPACING;
+}
+
+bool NowServer::sendGroup(const NowRecipients &recipients, const uint8_t *data, int length, GroupCompleteCallback done)
+{
+    if (!recipients.length())
     {
-        uint8_t cmac[6];
-        Helpers::parseMac(client.macAddress, cmac);
-        if (Helpers::macEquals(cmac, mac)) 
+        printDebug("    (sendGroup) No recipients.", 1);
+        return false;
+    }
+    return sendGroupFrame(0, recipients, data, length, done);
+}
+
+bool NowServer::sendGroup(uint8_t group, const uint8_t *data, int length, GroupCompleteCallback done)
+{
+    if ((group == 0) || (group > NOW_GROUPS))
+    {
+        printDebug("    (sendGroup) No such group: " + String(group), 1);
+        return false;
+    }
+    return sendGroupFrame(group, NowRecipients(), data, length, done);
+}
+
+bool NowServer::sendGroupFrame(uint8_t group, const NowRecipients &recipients, const uint8_t *data, int length, GroupCompleteCallback done)
+{
+    NowGroupHeader header;
+    header.group = group;
+    header.flags = done ? NOW_GROUP_ACK : 0;
+    header.bitmapLength = (uint8_t)recipients.length();
+    int prefix = sizeof(header) + header.bitmapLength;
+    if ((length < 0) || (prefix + length > (int)NOW_MAX_PAYLOAD))
+    {
+        printDebug("    (sendGroup) Unable to send " + String(length) + " bytes to a group.", 1);
+        return false;
+    }
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    GroupSend *send = nullptr;
+    if (done)
+    {
+        for (GroupSend &s : groupSends)
         {
-            outClient = client;
-            return;
+            if (!s.used) send = &s;
         }
+        if (!send)
+        {
+            printDebug("    (sendGroup) Too many group sends waiting for acknowledgements.", 1);
+            return false;
+        }
+    }
+    header.msgId = nextGroupId++;
+    NowMsg single;
+    NowMsg &out = send ? send->msg : single;
+    unsigned long now = transport->millis();
+    buildMsg(out, NOW_DT_GROUP, macAddress, broadcastMac, nullptr, 0);
+    memcpy(out.payload, &header, sizeof(header));
+    memcpy(out.payload + sizeof(header), recipients.bits, header.bitmapLength);
+    if (length) memcpy(out.payload + prefix, data, length);
+    out.length = (uint16_t)(prefix + length);
+    if (send)
+    {
+        send->used = true;
+        send->msgId = header.msgId;
+        send->recipients = recipients;
+        send->acked = NowRecipients();
+        send->retries = 0;
+        send->due = now + ackWait(recipients);
+        send->done = done;
+        //  the worker may be asleep past the deadline
+        transport->wake();
+    }
+    return sendMsg(broadcastMac, out);
+}
+
+void NowServer::finishGroup(GroupSend &send)
+{
+    NowRecipients missing;
+    for (int i = 0; i < NOW_GROUP_BITMAP; i++) missing.bits[i] = send.recipients.bits[i] & ~send.acked.bits[i];
+    GroupCompleteCallback done = send.done;
+    send.used = false;
+    send.done = nullptr;
+    if (done) done(send.acked, missing);
+}
+
+bool NowServer::workDue(unsigned long &due)
+{
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    bool any = false;
+    for (GroupSend &send : groupSends)
+    {
+        if (!send.used) continue;
+        if (!any || ((long)(send.due - due) < 0)) due = send.due;
+        any = true;
+    }
+    return any;
+}
+
+void NowServer::work(unsigned long now, unsigned long ticks)
+{
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    if ((beaconTimer >= 0) && tdmaChanged.exchange(false, std::memory_order_relaxed))
+    {
+        if (tdmaSlot.load(std::memory_order_relaxed)) timers.arm(beaconTimer, now);
+        else
+        {
+            //  clients go back to sending when they like once the beacons stop
+            timers.cancel(beaconTimer);
+            tdma.stop();
+        }
+    }
+    for (GroupSend &send : groupSends)
+    {
+        if (!send.used || ((long)(now - send.due) < 0)) continue;
+        NowRecipients missing;
+        for (int i = 0; i < NOW_GROUP_BITMAP; i++) missing.bits[i] = send.recipients.bits[i] & ~send.acked.bits[i];
+        if (!missing.length() || (send.retries >= NOW_GROUP_RETRIES))
+        {
+            finishGroup(send);
+            continue;
+        }
+        //  again, only to the ones missing - the bitmap keeps its length
+        printDebug("(work) Resending group message " + String(send.msgId) + " to " + String(missing.count()) + " clients", 0);
+        memcpy(send.msg.payload + sizeof(NowGroupHeader), missing.bits, send.recipients.length());
+        send.retries++;
+        send.due = now + ackWait(missing);
+        sendMsg(broadcastMac, send.msg);
+    }
+}
+
+int NowServer::clientCount() const
+{
+    return clients.count();
+}
+
+bool NowServer::isBound(const uint8_t *mac)
+{
+    ClientData *client = clients.find(mac);
+    return client && (client->state == CLIENT_DATA_CONFIRM);
+}
+
+int NowServer::slotOf(const uint8_t *mac)
+{
+    ClientData *client = clients.find(mac);
+    return client ? clients.slotOf(client) : -1;
+}
+
+void NowServer::boundClients(NowRecipients &out)
+{
+    out = NowRecipients();
+    for (int i = 0; i < clients.capacity(); i++)
+    {
+        ClientData *client = clients.at(i);
+        if (client && (client->state == CLIENT_DATA_CONFIRM)) out.set(i);
     }
 }
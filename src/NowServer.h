@@ -1,28 +1,101 @@
 #pragma once
 
 #include <Arduino.h>
-#include <vector>
 
 #include "NowService.h"
 #include "ClientData.h"
+#include "ClientTable.h"
 
 class NowServer : public NowService
 {
 private:
-    std::vector<ClientData> clients;
-    unsigned long clientTimeout = 300000;
-    unsigned long clientLast = 0;
+    ClientTable clients;
+    int clientTimers[NOW_MAX_CLIENTS];
+    uint16_t solicitWindow = NOW_SOLICIT_WINDOW;
+    std::atomic<uint16_t> tdmaSlot{0};      //  ms, 0 = no TDMA schedule
+    std::atomic<bool> tdmaChanged{false};   //  for the worker to start or stop beacons
+    int beaconTimer = -1;
 
-    void addClient(String name, String address, int state);
-    void getClient(const uint8_t *mac, ClientData &outClient);
+public:
+    using GroupCompleteCallback = std::function<void(const NowRecipients &acked, const NowRecipients &missing)>;
+
+private:
+    //  a group send collecting acknowledgements
+    struct GroupSend
+    {
+        bool used = false;
+        uint16_t msgId = 0;
+        NowRecipients recipients;   //  empty when sent to a group id
+        NowRecipients acked;
+        int retries = 0;
+        unsigned long due = 0;
+        GroupCompleteCallback done;
+        NowMsg msg;
+    };
+    GroupSend groupSends[NOW_GROUP_PENDING];
+    uint16_t nextGroupId = 0;
+
+    ClientData *addClient(String name, const uint8_t *mac);
+    void removeClient(ClientData *client);
+    void updateBound();
+    void checkClient(int slot, unsigned long now);
+    bool sendGroupFrame(uint8_t group, const NowRecipients &recipients, const uint8_t *data, int length, GroupCompleteCallback done);
+    void finishGroup(GroupSend &send);
+    void sendBeacon(unsigned long now);
+
+    using Handler = void (NowServer::*)(const NowMsg *m, ClientData *client, unsigned long now);
+    struct Route
+    {
+        Handler handler;
+        bool bound;     //  only from bound clients, proof they are there
+    };
+    static const Route routes[NOW_DT_COUNT];
+
+    void advertiseReceived(const NowMsg *m, ClientData *client, unsigned long now);
+    void handshakeReceived(const NowMsg *m, ClientData *client, unsigned long now);
+    void heartbeatReceived(const NowMsg *m, ClientData *client, unsigned long now);
+    void dataFrameReceived(const NowMsg *m, ClientData *client, unsigned long now);
+    void fragmentFrameReceived(const NowMsg *m, ClientData *client, unsigned long now);
+    void dataAckFrameReceived(const NowMsg *m, ClientData *client, unsigned long now);
+    void groupAckReceived(const NowMsg *m, ClientData *client, unsigned long now);
+    void reply(const NowMsg *m, uint8_t datatype, unsigned long now, const void *payload = nullptr, uint16_t length = 0);
 
 protected:
-    void work(unsigned long now, unsigned long ticks) override;
     void initialize() override;
+    bool workDue(unsigned long &due) override;
+    void work(unsigned long now, unsigned long ticks) override;
+    uint32_t slotWait(uint8_t datatype, uint32_t nowUs) override;
+    PeerLink *peerLink(const uint8_t *mac) override;
+    void peerMetrics(NowMetricsSnapshot &out) override;
 
 public:
-    NowServer();
+    NowServer(NowTransport *transport = nullptr);
     ~NowServer();
 
     void dataReceived(const uint8_t *mac, const uint8_t *incomingData, int len) override;
+
+    //  broadcast - unbound clients advertise within the window instead of
+    //  waiting out their backoff. begin() solicits too, unless window is 0.
+    void setSolicitWindow(uint16_t window);
+    void solicit();
+    //  a TDMA schedule for dense networks - a beacon starts every
+    //  superframe, each bound client transmits only in its slot of
+    //  slotLength ms, binding happens in a contention window and our queued
+    //  data goes out in the downlink. 0 = everyone sends when they like.
+    void setTdma(uint16_t slotLength = NOW_TDMA_SLOT);
+    int clientCount() const;
+    bool isBound(const uint8_t *mac);
+    //  session slot of a client, -1 if unknown - stable while it stays
+    int slotOf(const uint8_t *mac);
+    void boundClients(NowRecipients &out);
+    //  one broadcast frame to every client in recipients, each accepts or
+    //  ignores it on its own. With done they acknowledge, the frame goes
+    //  out again to the ones missing up to NOW_GROUP_RETRIES times, and done
+    //  tells who got it. Single frame, up to NOW_MAX_PAYLOAD less the
+    //  header and bitmap.
+    bool sendGroup(const NowRecipients &recipients, const uint8_t *data, int length, GroupCompleteCallback done = nullptr);
+    //  to the clients that joined group 1..NOW_GROUPS. The server doesn't
+    //  know the members, so done only gets who acknowledged and nothing is
+    //  sent again.
+    bool sendGroup(uint8_t group, const uint8_t *data, int length, GroupCompleteCallback done = nullptr);
 };
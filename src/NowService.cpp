@@ -1,109 +1,697 @@
-#include <WiFi.h>
-#include <iostream>
 #include <cstring>
 #include <Helpers.h>
-#include "esp_wifi.h"
-#include "esp_now.h"
 
 #include "NowService.h"
 #include "NowDebug.h"
-
-NowService *instance;
-int serviceModePrev = None;
-
-unsigned long lastTick = 0;
+#ifdef ESP_PLATFORM
+#include "EspNowTransport.h"
+#endif
 
 #pragma region NowService interface
 
-#pragma region Prototypes
-
-void worker(void *pvParameters);
-void onSent(const uint8_t *mac_addr, esp_now_send_status_t status);
-void onReceived(const uint8_t *mac, const uint8_t *incomingData, int len);
-
-#pragma endregion Prototypes
-
-NowService::NowService()
+NowService::NowService(NowTransport *transport)
+    : transport(transport), suspectDeviations(NowLiveness::deviations(NOW_LIVENESS_PHI))
 {
-    instance = this;
+#ifdef ESP_PLATFORM
+    if (!this->transport) this->transport = EspNowTransport::instance();
+#endif
 }
 
 NowService::~NowService()
 {
     serviceMode = Terminate;
-    delete (instance);
 }
 
 void NowService::initialize(BoundCallback peerBound, DataReceivedCallback dataRecevied)
+{
+    if (!begin(peerBound, dataRecevied)) return;
+
+    //  start the task
+    printDebug("    (initialize) Starting loop...", 1);
+    worker();
+}
+
+bool NowService::begin(BoundCallback peerBound, DataReceivedCallback dataRecevied)
 {
     printDebug("(initialize) Initializing...", 0);
 
     onPeerBound = peerBound;
     onDataReceived = dataRecevied;
 
-    //  initialize wifi first
-    WiFi.mode(WIFI_STA);
-    if (esp_now_init() != ESP_OK)
+    if (!transport)
     {
-        printDebug("    (initialize) Error initializing ESP-NOW", 1);
-        return;
+        printDebug("    (initialize) No transport available", 1);
+        return false;
     }
     //  register callbacks
-    esp_now_register_send_cb(onSent);
-    esp_now_register_recv_cb(esp_now_recv_cb_t(onReceived));
+    if (!transport->begin(
+            [this](const uint8_t *mac, const uint8_t *incomingData, int len) {
+                //  driver context - copy and hand over, nothing else
+                if (rxRing.push(mac, incomingData, len, transport->millis(), (uint32_t)transport->micros())) transport->wake();
+                else nowLog(NOW_LOG_RX_OVERRUN, Helpers::macToKey(mac), len, 0);
+            },
+            [this](const uint8_t *mac, bool success) {
+                //  driver context - record the result, the worker completes the frame
+                txDone.push(mac, success);
+                transport->wake();
+            }))
+    {
+        printDebug("    (initialize) Error initializing transport", 1);
+        return false;
+    }
     readMacAddress();
+    //  nodes powered up together have to drift apart
+    uint64_t key = Helpers::macToKey(macAddress);
+    randomState = (uint32_t)(key ^ (key >> 32)) ^ (uint32_t)transport->millis();
+    if (!randomState) randomState = 1;
+
+    reliableOut.begin(
+        [this](NowMsg &m) { return sendMsg(m.toMac, m); },
+        [this](int ticket, bool success) { txQueue.complete(ticket, success); });
 
     //  add omni channel
     printDebug("    (initialize) Register to receive data from omni channel", 1);
-    addSourceMac(broadcastMac);
+    peers.begin(transport);
+    relays.clear();
+    addSourceMac(broadcastMac, PEER_FIXED);
 
     //  do specific initialization
     memset(boundMac, 0x0, 6);
     initialize();
 
-    //  start the task
-    printDebug("    (initialize) Starting loop...", 1);
     Helpers::setFlag(Initialized, serviceMode);
-    worker();
+    lastTick = transport->millis();
+    return true;
+}
+
+void NowService::setPeerDataReceived(PeerDataReceivedCallback peerDataReceived)
+{
+    onPeerDataReceived = peerDataReceived;
+}
+
+void NowService::setDataViewReceived(DataViewCallback dataViewReceived)
+{
+    onDataView = dataViewReceived;
 }
 
-bool NowService::sendData(const uint8_t *data, int length)
+void NowService::release(const NowDataView &view)
 {
-    printDebug("(sendData) Preparing to send data, To: " + Helpers::macToString(boundMac) + ", length: " + String(length), 0);
-    //  ensure that the data length is <= 230 bytes
-    if (length > 230)
+    if (view.source == NowDataView::Frame) rxRing.release(view.slot);
+    else if (view.source == NowDataView::Message) reassembly.release(view.slot);
+    else return;
+    //  the worker reclaims ring slots, a full ring may be waiting on this one
+    transport->wake();
+}
+
+void NowService::setReliable(bool enabled)
+{
+    reliable = enabled;
+}
+
+bool NowService::sendData(const uint8_t *data, int length, NowTraffic traffic)
+{
+    return sendData(boundMac, data, length, traffic);
+}
+
+bool NowService::sendData(const uint8_t *mac, const uint8_t *data, int length, NowTraffic traffic)
+{
+    printDebug("(sendData) Preparing to send data, To: " + Helpers::macToString(mac) + ", length: " + String(length), 0);
+    if (traffic >= NOW_TRAFFIC_CLASSES) return false;
+    return queueData(mac, data, length, 0, traffic);
+}
+
+bool NowService::subscribe(uint8_t topic, DataViewCallback subscriber)
+{
+    if (topic >= NOW_TOPICS) return false;
+    topics[topic] = subscriber;
+    return true;
+}
+
+void NowService::unsubscribe(uint8_t topic)
+{
+    if (topic < NOW_TOPICS) topics[topic] = nullptr;
+}
+
+bool NowService::publish(uint8_t topic, const uint8_t *data, int length)
+{
+    return publish(boundMac, topic, data, length);
+}
+
+bool NowService::publish(const uint8_t *mac, uint8_t topic, const uint8_t *data, int length)
+{
+    if ((topic >= NOW_TOPICS) || (length < 0) || (length > NOW_PUBLISH_MAX))
     {
-        printDebug("    (sendData) Unable to send more than 230 bytes for now.", 1);
+        printDebug("    (publish) Unable to publish " + String(length) + " bytes on topic " + String(topic), 1);
         return false;
     }
-    NowMsg out{};
-    if (!buildMsg(out, NOW_DT_DATA, macAddress, boundMac, data, length, millis()))
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    publishBuffer[0] = topic;
+    if (length) memcpy(publishBuffer + NOW_TOPIC_PREFIX, data, length);
+    return queueData(mac, publishBuffer, NOW_TOPIC_PREFIX + length, NOW_FLAG_TOPIC, NOW_TRAFFIC_REALTIME);
+}
+
+bool NowService::queueData(const uint8_t *mac, const uint8_t *data, int length, uint8_t flags, NowTraffic traffic)
+{
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    //  on a TDMA schedule messages collect in a batch until our window
+    unsigned long delay = batchDelay;
+    uint32_t nowUs = (uint32_t)transport->micros();
+    uint32_t wait = slotted(nowUs) ? slotWait(NOW_DT_DATA, nowUs) : 0;
+    if ((wait + 999) / 1000 > delay) delay = (wait + 999) / 1000;
+    if ((delay == 0) || (length <= 0) || (length > (int)NOW_MAX_BATCHED))
     {
-        printDebug("    (sendData) Unable to build message.", 1);
+        //  what is batched for the peer goes first, so messages keep their order
+        if (batchCount && Helpers::macEquals(batchMac, mac) && !flushBatch()) return false;
+        return sendFrames(mac, data, length, flags, traffic);
+    }
+
+    //  a batch only goes to one peer in one class, its messages all have a
+    //  topic or none
+    if (batchCount && (!Helpers::macEquals(batchMac, mac) || (batchFlags != flags) || (batchTraffic != traffic)) &&
+        !flushBatch())
         return false;
+    if (!batchAppend(batchBuffer, batchLength, data, length))
+    {
+        if (!flushBatch()) return false;
+        batchAppend(batchBuffer, batchLength, data, length);
     }
-    if (!sendMsg(boundMac, out)) 
+    if (batchCount++ == 0)
+    {
+        memcpy(batchMac, mac, 6);
+        batchFlags = flags;
+        batchTraffic = traffic;
+        batchDue = transport->millis() + delay;
+        //  the worker sends the batch if nothing else fills it in time
+        transport->wake();
+    }
+    //  no room for even a single byte message
+    if (batchLength > (int)(NOW_MAX_PAYLOAD - NOW_BATCH_PREFIX - 1)) flushBatch();
+    return true;
+}
+
+bool NowService::sendFrames(const uint8_t *mac, const uint8_t *data, int length, uint8_t flags, NowTraffic traffic)
+{
+    //  a message more frames than the send queue holds goes straight to the driver
+    int room = NOW_TX_QUEUE - ((traffic == NOW_TRAFFIC_BULK) ? NOW_TX_RESERVED : 0);
+    if ((traffic != NOW_TRAFFIC_CONTROL) && (dataFrames(length) <= room)) return queueFrames(mac, data, length, flags, nullptr, traffic);
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    uint8_t packed[NOW_MAX_PAYLOAD];
+    length = compressData(data, length, flags, packed);
+    int frames = dataFrames(length);
+    if (frames == 0)
+    {
+        printDebug("    (sendData) Unable to send more than " + String(NOW_MAX_MESSAGE) + " bytes.", 1);
+        return false;
+    }
+    PeerLink *link = reliable ? peerLink(mac) : nullptr;
+    uint64_t key = Helpers::macToKey(mac);
+    if (link && !reliableOut.canSend(key, *link, frames))
+    {
+        printDebug("    (sendData) Reliable window is full.", 1);
+        return false;
+    }
+    return buildData(mac, data, length, [&](NowMsg &out) {
+        //  a reliable frame that didn't make it out is retransmitted
+        if (link)
+        {
+            reliableOut.track(key, *link, out, transport->millis());
+            //  the worker may be asleep past the retransmission timeout
+            transport->wake();
+        }
+        if (!sendMsg(mac, out) && !link)
+        {
+            printDebug("    (sendData) Unable to send message.", 1);
+            return false;
+        }
+        return true;
+    }, flags);
+}
+
+void NowService::setBatching(unsigned long delay)
+{
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    batchDelay = delay;
+    if (batchDelay == 0) flushBatch();
+}
+
+bool NowService::flush()
+{
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    return flushBatch();
+}
+
+void NowService::setCompression(bool enabled)
+{
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    compression = enabled;
+}
+
+void NowService::setLiveness(unsigned long heartbeatInterval, float phi)
+{
+    if (!heartbeatInterval || (phi <= 0)) return;
+    this->heartbeatInterval = heartbeatInterval;
+    suspectDeviations = NowLiveness::deviations(phi);
+}
+
+int NowService::compressData(const uint8_t *&data, int length, uint8_t &flags, uint8_t *packed)
+{
+    //  only worth it when the message ends up in fewer frames or bytes
+    if (!compression || (length < NOW_COMPRESS_MIN) || (length > NOW_COMPRESS_MAX)) return length;
+    int limit = (length <= (int)NOW_MAX_PAYLOAD) ? length - 1 : (int)NOW_MAX_PAYLOAD;
+    int packedLength = lz.compress(data, length, packed, limit);
+    if (packedLength == 0) return length;
+    data = packed;
+    flags |= NOW_FLAG_COMPRESSED;
+    return packedLength;
+}
+
+bool NowService::flushBatch()
+{
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    if (batchCount == 0) return true;
+    //  keep the batch while the reliable window is closed
+    PeerLink *link = reliable ? peerLink(batchMac) : nullptr;
+    if (link && !reliableOut.canSend(Helpers::macToKey(batchMac), *link, 1)) return false;
+    bool result;
+    //  a lone message goes out as plain data
+    if (batchCount == 1) result = sendFrames(batchMac, batchBuffer + NOW_BATCH_PREFIX, batchLength - NOW_BATCH_PREFIX, batchFlags, batchTraffic);
+    else result = sendFrames(batchMac, batchBuffer, batchLength, batchFlags | NOW_FLAG_BATCH, batchTraffic);
+    //  and while the send queue is full
+    if (!result && (batchTraffic != NOW_TRAFFIC_CONTROL)) return false;
+    batchLength = 0;
+    batchCount = 0;
+    return result;
+}
+
+bool NowService::sendDataAsync(const uint8_t *data, int length, SendCompleteCallback done, NowTraffic traffic)
+{
+    return sendDataAsync(boundMac, data, length, done, traffic);
+}
+
+bool NowService::sendDataAsync(const uint8_t *mac, const uint8_t *data, int length, SendCompleteCallback done, NowTraffic traffic)
+{
+    return queueFrames(mac, data, length, 0, done, traffic);
+}
+
+bool NowService::queueFrames(const uint8_t *mac, const uint8_t *data, int length, uint8_t flags, SendCompleteCallback done,
+                             NowTraffic traffic)
+{
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    uint8_t packed[NOW_MAX_PAYLOAD];
+    length = compressData(data, length, flags, packed);
+    int frames = dataFrames(length);
+    if (frames == 0) return false;
+    if ((traffic >= NOW_TRAFFIC_CLASSES) || (txQueue.freeFrames(traffic) < frames))
     {
-        printDebug("    (sendData) Unable to send message.", 1);
+        printDebug("    (queueFrames) Send queue is full.", 1);
         return false;
     }
+    int ticket = txQueue.open(done, frames, traffic);
+    if (ticket < 0) return false;
+    bool queued = buildData(mac, data, length, [&](NowMsg &out) {
+        TxQueue::Frame *frame = txQueue.push(traffic);
+        memcpy(&frame->msg, &out, msgSize(out));
+        memcpy(frame->mac, mac, 6);
+        frame->reliable = reliable;
+        frame->ticket = (int8_t)ticket;
+        return true;
+    }, flags);
+    pumpTx();
+    return queued;
+}
+
+void NowService::setMaxInFlight(int frames)
+{
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    txQueue.maxInFlight = (frames > 0) ? frames : 1;
+}
+
+uint32_t NowService::rxOverruns() const
+{
+    return rxRing.overruns.load(std::memory_order_relaxed);
+}
+
+void NowService::metrics(NowMetricsSnapshot &out)
+{
+    out.now = transport ? transport->millis() : 0;
+    counters.read(out);
+    out.rxOverruns = rxOverruns();
+    out.rxQueued = rxRing.size();
+    out.reassemblyExpired = reassembly.expired;
+    out.reassemblyDropped = reassembly.dropped;
+    out.peerRegistrations = peers.registered;
+    out.peerEvictions = peers.evicted;
+    {
+        std::lock_guard<std::recursive_mutex> lock(txLock);
+        out.retransmits = reliableOut.retransmits;
+        out.reliableFailures = reliableOut.failures;
+        out.txQueued = txQueue.size();
+    }
+    out.clockOffset = clock.offset();
+    out.clockDrift = clock.driftPpm();
+    out.clockDelay = clock.delay();
+    out.peerCount = 0;
+    peerMetrics(out);
+}
+
+bool NowService::clockSynced() const
+{
+    return clock.isSynced();
+}
+
+uint32_t NowService::networkMicros()
+{
+    return clock.toNetwork((uint32_t)transport->micros());
+}
+
+uint32_t NowService::toNetworkMicros(uint32_t local) const
+{
+    return clock.toNetwork(local);
+}
+
+int NowService::queuedFrames()
+{
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    return txQueue.size();
+}
+
+void NowService::pumpTx()
+{
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    //  on a TDMA schedule one frame at a time, so each finishes in the window
+    uint32_t nowUs = (uint32_t)transport->micros();
+    bool paced = slotted(nowUs);
+    //  classes waiting on a reliable window, the others may still go
+    uint8_t blocked = 0;
+    while (txQueue.canTransmit() && !(paced && txQueue.inFlight()))
+    {
+        TxQueue::Frame *frame = txQueue.front(blocked);
+        if (!frame) return;
+        uint32_t wait = slotWait(frame->msg.datatype, nowUs);
+        if (wait)
+        {
+            //  the worker comes back when the window opens
+            unsigned long resume = transport->millis() + (wait + 999) / 1000;
+            if (!txHeld || (resume != txResume)) transport->wake();
+            txHeld = true;
+            txResume = resume;
+            return;
+        }
+        txHeld = false;
+        if (frame->reliable)
+        {
+            PeerLink *link = peerLink(frame->mac);
+            uint64_t key = Helpers::macToKey(frame->mac);
+            if (!link)
+            {
+                //  the peer went away while we were queued
+                txQueue.complete(frame->ticket, false);
+                txQueue.pop();
+                continue;
+            }
+            //  wait for acks to open the window, the class keeps its order
+            if (!reliableOut.canSend(key, *link, 1))
+            {
+                blocked |= (uint8_t)(1 << txQueue.frontTraffic());
+                continue;
+            }
+            //  reliable frames complete when acknowledged, not when sent
+            reliableOut.track(key, *link, frame->msg, transport->millis(), frame->ticket);
+            transport->wake();
+            transmitMsg(frame->mac, frame->msg, -1);
+        }
+        else if (!transmitMsg(frame->mac, frame->msg, frame->ticket))
+        {
+            txQueue.complete(frame->ticket, false);
+        }
+        txQueue.pop();
+    }
+}
+
+int NowService::dataFrames(int length) const
+{
+    if ((length <= 0) || (length > NOW_MAX_MESSAGE)) return 0;
+    //  anything that doesn't fit a single frame goes out in fragments
+    if (length <= (int)NOW_MAX_PAYLOAD) return 1;
+    return fragmentCount((uint16_t)length);
+}
+
+bool NowService::buildData(const uint8_t *mac, const uint8_t *data, int length, const std::function<bool(NowMsg &)> &emit, uint8_t flags)
+{
+    NowMsg out{};
+    if (length <= (int)NOW_MAX_PAYLOAD)
+    {
+        if (!buildMsg(out, NOW_DT_DATA, macAddress, mac, data, length))
+        {
+            printDebug("    (sendData) Unable to build message.", 1);
+            return false;
+        }
+        out.flags = flags;
+        return emit(out);
+    }
+
+    uint16_t total = (uint16_t)length;
+    uint8_t count = fragmentCount(total);
+    uint16_t msgId = nextMsgId++;
+    printDebug("    (sendData) Sending " + String(count) + " fragments, id: " + String(msgId), 1);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        NowFragment f;
+        f.msgId = msgId;
+        f.totalLength = total;
+        f.index = i;
+        f.count = count;
+        uint16_t n = fragmentLength(total, i);
+        memcpy(f.data, data + (size_t)i * NOW_FRAGMENT_DATA, n);
+
+        if (!buildMsg(out, NOW_DT_FRAGMENT, macAddress, mac, &f, NOW_FRAGMENT_HEADER + n))
+        {
+            return false;
+        }
+        //  every fragment carries the message flags
+        out.flags = flags;
+        if (!emit(out)) return false;
+    }
     return true;
 }
 
-bool NowService::sendMsg(const uint8_t* mac, const NowMsg& m) 
+void NowService::fragmentReceived(const uint8_t *mac, const NowMsg *m)
+{
+    int slot = reassembly.add(Helpers::macToKey(mac), *m, transport->millis());
+    if (slot < 0) return;
+    deliverData(mac, reassembly.data(slot), reassembly.length(slot), slot, m->flags);
+    reassembly.done(slot);
+}
+
+PeerLink *NowService::peerLink(const uint8_t *mac)
 {
-    int length = sizeof(NowMsg);
-    esp_err_t result = esp_now_send(mac, (uint8_t*)&m, length);
+    return nullptr;
+}
+
+bool NowService::reliableReceived(const uint8_t *mac, const NowMsg *m, PeerLink *link)
+{
+    if (!(m->flags & NOW_FLAG_RELIABLE)) return true;
+    if (!link) return false;
+    bool accepted = link->accept(m->seq);
+    //  acknowledge duplicates too, the previous ack may have been lost
+    NowDataAck ack;
+    ack.next = link->rxNext;
+    ack.mask = link->rxMask;
+    ack.echo = m->seq;
+    NowMsg out{};
+    if (buildMsg(out, NOW_DT_DATA_ACK, macAddress, mac, &ack, sizeof(ack)))
+    {
+        sendMsg(mac, out);
+    }
+    return accepted;
+}
+
+void NowService::dataAckReceived(const uint8_t *mac, const NowMsg *m, PeerLink *link)
+{
+    if (!link || (m->length != sizeof(NowDataAck))) return;
+    NowDataAck ack;
+    memcpy(&ack, m->payload, sizeof(ack));
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    reliableOut.acked(Helpers::macToKey(mac), *link, ack, transport->millis());
+    //  the window may have opened for queued frames
+    pumpTx();
+}
+
+void NowService::forgetPeer(const uint8_t *mac)
+{
+    //  drop anything still waiting on this peer's acks, and let its driver
+    //  registration go first when room is needed
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    reliableOut.forget(Helpers::macToKey(mac));
+    peers.release(mac);
+}
+
+void NowService::deliverData(const uint8_t *mac, const uint8_t *data, int length, int message, uint8_t flags)
+{
+    if ((flags & NOW_FLAG_TOPIC) ? (length < NOW_TOPIC_PREFIX) : (length <= 0)) return;
+    NowDataView view;
+    memcpy(view.mac, mac, 6);
+    view.data = data;
+    view.length = length;
+    view.timestamp = transport->millis();
+    view.latency = rxLatency;
+    if (message >= 0)
+    {
+        view.source = NowDataView::Message;
+        view.slot = (int16_t)message;
+    }
+    RxRing::Slot *slot = (message < 0) ? rxCurrent : nullptr;
+    if (slot && onDataView && !rxRing.contains(slot, data))
+    {
+        //  a legacy frame was decoded into scratch - its payload still fits
+        //  the slot it arrived in
+        memcpy(slot->data, data, length);
+        view.data = slot->data;
+    }
+    if (slot && rxRing.contains(slot, view.data))
+    {
+        view.timestamp = slot->receivedAt;
+        view.source = NowDataView::Frame;
+        view.slot = (int16_t)rxRing.indexOf(slot);
+    }
+    if (flags & NOW_FLAG_TOPIC)
+    {
+        view.topic = view.data[0];
+        view.data += NOW_TOPIC_PREFIX;
+        view.length -= NOW_TOPIC_PREFIX;
+    }
+    deliverView(view, const_cast<uint8_t *>(view.data));
+}
+
+void NowService::deliverFrame(const uint8_t *mac, const NowMsg *m)
+{
+    const uint8_t *payload = m->payload;
+    int length = m->length;
+    int message = -1;
+    if (m->flags & NOW_FLAG_COMPRESSED)
+    {
+        //  expanded into a buffer of the pool, so views can still be leased
+        message = reassembly.claim(transport->millis());
+        if (message < 0) return;
+        length = NowLz::decompress(m->payload, m->length, reassembly.buffer(message), NOW_COMPRESS_MAX);
+        payload = reassembly.buffer(message);
+        if (length > 0) reassembly.setLength(message, (uint16_t)length);
+    }
+    if (!(m->flags & NOW_FLAG_BATCH))
+    {
+        deliverData(mac, payload, length, message, m->flags);
+    }
+    else
+    {
+        //  one delivery per packed message
+        int offset = 0;
+        const uint8_t *data;
+        int part;
+        while (batchNext(payload, length, offset, data, part))
+        {
+            deliverData(mac, data, part, message, m->flags);
+        }
+    }
+    if (message >= 0) reassembly.done(message);
+}
+
+void NowService::deliverView(NowDataView &view, uint8_t *data)
+{
+    //  make received data available to the consumer, in place - the older
+    //  callbacks see the buffer for the duration of the call
+    DataViewCallback *subscriber = (view.topic < NOW_TOPICS) ? &topics[view.topic] : nullptr;
+    if (!subscriber || !*subscriber) subscriber = onDataView ? &onDataView : nullptr;
+    if (subscriber)
+    {
+        //  leased before the call, the consumer may release right away
+        if (view.source == NowDataView::Frame) rxRing.lease(view.slot);
+        else if (view.source == NowDataView::Message) reassembly.lease(view.slot);
+        (*subscriber)(view);
+    }
+    else if (onPeerDataReceived) onPeerDataReceived(view.mac, data, view.length);
+    else if (onDataReceived) onDataReceived(data, view.length);
+}
+
+bool NowService::sendMsg(const uint8_t* mac, NowMsg& m, int ticket) 
+{
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    //  behind the frames already waiting for our window
+    uint32_t nowUs = (uint32_t)transport->micros();
+    if (slotted(nowUs) && (txQueue.size() || txQueue.inFlight() || slotWait(m.datatype, nowUs))) return holdMsg(mac, m, ticket);
+    return transmitMsg(mac, m, ticket);
+}
+
+bool NowService::holdMsg(const uint8_t *mac, const NowMsg &m, int ticket)
+{
+    TxQueue::Frame *frame = txQueue.push(NOW_TRAFFIC_CONTROL);
+    if (!frame)
+    {
+        printDebug("    (sendMsg) Send queue is full.", 1);
+        NowMetrics::count(counters.sendErrors);
+        return false;
+    }
+    memcpy(&frame->msg, &m, msgSize(m));
+    memcpy(frame->mac, mac, 6);
+    frame->reliable = false;
+    frame->ticket = (int8_t)ticket;
+    //  the worker sends it once the window opens
+    transport->wake();
+    return true;
+}
+
+bool NowService::transmitMsg(const uint8_t *mac, NowMsg &m, int ticket)
+{
+    int length = msgSize(m);
+    //  relayed frames keep the time they set out
+    if (!m.hops)
+    {
+        m.timestamp = clock.toNetwork((uint32_t)transport->micros());
+        if (clock.isSynced()) m.flags |= NOW_FLAG_SYNCED;
+        else m.flags &= (uint8_t)~NOW_FLAG_SYNCED;
+    }
+    sealMsg(m);
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    //  nodes out of range go through the relay they were heard over
+    uint8_t via[6];
+    const uint8_t *hop = relays.nextHop(mac, via) ? via : mac;
+    bool result = peers.ensure(hop) && transport->send(hop, (const uint8_t*)&m, length);
+    if (!result) NowMetrics::count(counters.sendErrors);
+    else if (m.datatype < NOW_DT_COUNT) NowMetrics::count(counters.sent[m.datatype]);
+    nowLog(result ? NOW_LOG_SENT : NOW_LOG_SEND_FAILED, Helpers::macToKey(mac), m.datatype, length);
+    //  every frame the driver accepted gets a send callback
+    if (result) txQueue.sent(ticket);
     printDebug("(sendData) sending data result: " + String(result) + ", length: " + String(length), 0);
-    return (result == ESP_OK) ? true : false;
+    return result;
 }
 
-void NowService::sendHeartbeat(const uint8_t *mac)
+uint32_t NowService::sendHeartbeat(const uint8_t *mac, const NowClockSync *answering)
 {
     printDebug("(sendHeartbeat) Sending heartbeat", 0);
+    NowClockSync sync;
+    sync.origin = answering ? answering->sent : 0;
+    sync.received = answering ? receivedMicros() : 0;
     NowMsg m{};
-    if (!buildMsg(m, NOW_DT_HEARTBEAT, macAddress, mac, nullptr, 0, millis())) return;
-    sendMsg(mac, m);
+    if (!buildMsg(m, NOW_DT_HEARTBEAT, macAddress, mac, &sync, sizeof(sync))) return 0;
+    //  as late as it gets
+    sync.sent = (uint32_t)transport->micros();
+    memcpy(m.payload + offsetof(NowClockSync, sent), &sync.sent, sizeof(sync.sent));
+    return sendMsg(mac, m) ? sync.sent : 0;
+}
+
+uint32_t NowService::receivedMicros()
+{
+    return rxCurrent ? rxCurrent->receivedUs : (uint32_t)transport->micros();
+}
+
+void NowService::sendSolicit(uint16_t window, uint8_t flags)
+{
+    printDebug("(sendSolicit) Soliciting advertisements within " + String(window) + "ms", 0);
+    NowSolicit payload;
+    payload.window = window;
+    NowMsg m{};
+    if (!buildMsg(m, NOW_DT_SOLICIT, macAddress, broadcastMac, &payload, sizeof(payload))) return;
+    m.flags = flags;
+    sendMsg(broadcastMac, m);
 }
 
 #pragma endregion NowService interface
@@ -113,8 +701,7 @@ void NowService::sendHeartbeat(const uint8_t *mac)
 void NowService::readMacAddress()
 {
     printDebug("(readMacAddress) Reading own MAC Address...", 0);
-    esp_err_t ret = esp_wifi_get_mac(WIFI_IF_STA, macAddress);
-    if (ret == ESP_OK)
+    if (transport->readMacAddress(macAddress))
     {
         printDebug("    (readMacAddress) Success: " + Helpers::macToString(macAddress), 1);
     }
@@ -124,18 +711,20 @@ void NowService::readMacAddress()
     }
 }
 
-void NowService::addSourceMac(const uint8_t *sourceMac)
+uint32_t NowService::nextRandom(uint32_t range)
 {
-    if (esp_now_is_peer_exist(sourceMac)) return;
+    //  xorshift32
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return range ? randomState % range : 0;
+}
 
+void NowService::addSourceMac(const uint8_t *sourceMac, PeerHold hold)
+{
     printDebug("(addSourceMac) adding peer: " + Helpers::macToString(sourceMac), 0);
-    const uint8_t m[6] = {sourceMac[0], sourceMac[1], sourceMac[2], sourceMac[3], sourceMac[4], sourceMac[5]};
-    esp_now_peer_info peer;
-    memset(&peer, 0, sizeof(esp_now_peer_info_t));
-    peer.channel = 0;
-    peer.encrypt = false;
-    memcpy(peer.peer_addr, m, 6);
-    if (esp_now_add_peer(&peer) != ESP_OK)
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    if (!peers.ensure(sourceMac, hold))
     {
         printDebug("    (addSourceMac) Failed to add peer", 1);
     }
@@ -144,14 +733,10 @@ void NowService::addSourceMac(const uint8_t *sourceMac)
 void NowService::removeSourceMac(const uint8_t *sourceMac)
 {
     printDebug("(removeSourceMac) Removing source: " + Helpers::macToString(sourceMac), 0);
-    if (!esp_now_is_peer_exist(sourceMac)) return;
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    if (!peers.contains(sourceMac)) return;
 
-    esp_now_peer_info_t peerInfo = {};
-    memcpy(peerInfo.peer_addr, sourceMac, 6);
-    peerInfo.channel = 0; // 0 = current channel
-    peerInfo.encrypt = false;
-
-    if (esp_now_del_peer(sourceMac) != ESP_OK)
+    if (!peers.remove(sourceMac))
     {
         printDebug("    (removeSourceMac) Failed to remove source: " + Helpers::macToString(sourceMac), 1);
     }
@@ -169,22 +754,148 @@ void NowService::worker()
 {
     while (!Helpers::flagIsSet(Terminate, serviceMode))
     {
-        if (serviceMode != serviceModePrev)
-        {
-            printDebug("(worker) service mode changed: " + String(serviceMode) + " (" + String(serviceModePrev) + ")", 0);
-            serviceModePrev = serviceMode;
-        }
+        unsigned long sleep = step();
+
+        //  give back to the processor until the next deadline or frame
+        transport->delay(sleep);
+    }
+    printDebug("    (worker) The End!", 1);
+}
+
+unsigned long NowService::step()
+{
+    if (serviceMode != serviceModePrev)
+    {
+        printDebug("(worker) service mode changed: " + String(serviceMode) + " (" + String(serviceModePrev) + ")", 0);
+        serviceModePrev = serviceMode;
+    }
 
-        unsigned long now = millis();
-        unsigned long ticks = now - lastTick;
-        lastTick = now;
+    unsigned long now = transport->millis();
+    unsigned long ticks = now - lastTick;
+    lastTick = now;
 
-        work(now, ticks);
+    processReceived();
+    processSent();
+    reassembly.expire(now);
+    {
+        std::lock_guard<std::recursive_mutex> lock(txLock);
+        //  Nagle - a partial batch waited long enough
+        if (batchCount && ((long)(now - batchDue) >= 0) && !flushBatch()) batchDue = now + batchDelay;
+        reliableOut.poll(now);
+        pumpTx();
+    }
+    timers.run(now);
+    work(now, ticks);
+    return sleepTime(transport->millis());
+}
 
-        //  give back to the processor
-        vTaskDelay(1000);
+unsigned long NowService::sleepTime(unsigned long now)
+{
+    unsigned long at = now + NOW_MAX_SLEEP;
+    unsigned long due;
+    if (timers.next(due) && ((long)(due - at) < 0)) at = due;
+    if (reassembly.nextDue(due) && ((long)(due - at) < 0)) at = due;
+    {
+        std::lock_guard<std::recursive_mutex> lock(txLock);
+        if (reliableOut.nextDue(due) && ((long)(due - at) < 0)) at = due;
+        if (batchCount && ((long)(batchDue - at) < 0)) at = batchDue;
+        if (txHeld && txQueue.size() && ((long)(txResume - at) < 0)) at = txResume;
     }
-    printDebug("    (worker) The End!", 1);
+    if (workDue(due) && ((long)(due - at) < 0)) at = due;
+    long sleep = (long)(at - now);
+    return (sleep > 0) ? (unsigned long)sleep : 0;
+}
+
+const NowMsg *NowService::decodeFrame(const uint8_t *mac, const uint8_t *data, int len, NowMsg &scratch)
+{
+    NowFrameCheck check;
+    const NowMsg *m = decodeMsg(data, len, scratch, &check);
+    if (check == NOW_FRAME_CORRUPT)
+    {
+        NowMetrics::count(counters.corrupted);
+        nowLog(NOW_LOG_REJECTED, Helpers::macToKey(mac), len, check);
+        return nullptr;
+    }
+    //  with nothing else to go by, a legacy frame has to be addressed to us
+    bool stray = m && (m->version == NOW_WIRE_LEGACY) && !Helpers::macEquals(m->toMac, macAddress) &&
+                 !Helpers::macEquals(m->toMac, broadcastMac);
+    if (!m || stray || (m->datatype >= NOW_DT_COUNT))
+    {
+        NowMetrics::count(counters.rejected);
+        nowLog(NOW_LOG_REJECTED, Helpers::macToKey(mac), len, check);
+        return nullptr;
+    }
+    NowMetrics::count(counters.received[m->datatype]);
+    nowLog(NOW_LOG_RECEIVED, Helpers::macToKey(m->fromMac), m->datatype, len);
+    if (relayFrame(mac, m)) return nullptr;
+    rxLatency = -1;
+    if ((m->flags & NOW_FLAG_SYNCED) && clock.isSynced())
+    {
+        int32_t latency = (int32_t)(clock.toNetwork(receivedMicros()) - m->timestamp);
+        rxLatency = (latency > 0) ? latency : 0;
+        counters.oneWayLatency.record((unsigned long)rxLatency);
+    }
+    return m;
+}
+
+bool NowService::relayFrame(const uint8_t *mac, const NowMsg *m)
+{
+    if (m->version == NOW_WIRE_LEGACY) return false;
+    //  our own broadcast, back through a relay
+    if (Helpers::macEquals(m->fromMac, macAddress)) return true;
+    bool broadcast = Helpers::macEquals(m->toMac, broadcastMac);
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    //  every copy counts towards the best path, only the first is handled
+    relays.learn(m->fromMac, mac, m->hops, transport->millis());
+    if (broadcast && ((m->hops > 0) || (m->flags & NOW_FLAG_RELAY)) && relays.seen(*m))
+    {
+        NowMetrics::count(counters.relayDuplicates);
+        return true;
+    }
+    if (!broadcast && Helpers::macEquals(m->toMac, macAddress)) return false;
+    //  a broadcast is handled here as well, someone else's unicast is only
+    //  passed on - by bound relays, within the hop limit
+    bool relaying = relay && Helpers::flagIsSet(Bound, serviceMode) && (m->hops < NOW_RELAY_MAX_HOPS);
+    if (broadcast && !(relaying && (m->datatype == NOW_DT_ADVERTISE) && (m->flags & NOW_FLAG_RELAY))) return false;
+    if (!relaying) return true;
+    //  broadcasts asking for a relay go up to our server, unicast towards
+    //  its destination
+    NowMsg out;
+    memcpy(&out, m, msgSize(*m));
+    out.hops++;
+    printDebug("(relayFrame) Relaying from " + Helpers::macToString(m->fromMac) + " to " + Helpers::macToString(broadcast ? boundMac : m->toMac), 0);
+    if (sendMsg(broadcast ? boundMac : m->toMac, out)) NowMetrics::count(counters.relayed);
+    return !broadcast;
+}
+
+void NowService::forgetRoute(const uint8_t *mac)
+{
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    relays.forget(mac);
+}
+
+void NowService::processReceived()
+{
+    while (RxRing::Slot *slot = rxRing.front())
+    {
+        rxCurrent = slot;
+        dataReceived(slot->mac, slot->data, slot->len);
+        rxCurrent = nullptr;
+        rxLatency = -1;
+        rxRing.pop();
+    }
+}
+
+void NowService::processSent()
+{
+    TxDoneRing::Result result;
+    while (txDone.pop(result)) dataSent(result.mac, result.success);
+    //  results the ring had no room for still free their frames
+    uint32_t lost = txDone.overruns.load(std::memory_order_relaxed);
+    if (lost == txDoneLost) return;
+    std::lock_guard<std::recursive_mutex> lock(txLock);
+    for (; txDoneLost != lost; txDoneLost++) txQueue.sendDone(false);
+    pumpTx();
 }
 
 #pragma endregion Worker Loop
@@ -196,31 +907,53 @@ void NowService::initialize()
     printDebug("*** (virtual intialize) This shouldn't happen", 1);
 }
 
+bool NowService::workDue(unsigned long &due)
+{
+    return false;
+}
+
 void NowService::work(unsigned long now, unsigned long ticks)
 {
-    printDebug("*** (virtual work) This shouldn't happen", 1);
+    //  periodic work is scheduled on timers
+}
+
+bool NowService::slotted(uint32_t nowUs)
+{
+    return false;
+}
+
+uint32_t NowService::slotWait(uint8_t datatype, uint32_t nowUs)
+{
+    return 0;
 }
 void NowService::dataReceived(const uint8_t *mac, const uint8_t *incomingData, int len)
 {
     printDebug("*** (virtual dataReceived) This shouldn't happen", 1);
 }
 
+void NowService::peerMetrics(NowMetricsSnapshot &out)
+{
+}
+
 #pragma endregion Virtuals
 
 #pragma region Callbacks
 
-void onSent(const uint8_t *mac_addr, esp_now_send_status_t status)
+void NowService::dataSent(const uint8_t *mac, bool success)
 {
-    printDebug("(onSent) data send to: " + Helpers::macToString(mac_addr) + ", status: " + String(status), 0);
-    if (status != ESP_OK)
+    nowLog(NOW_LOG_SEND_DONE, Helpers::macToKey(mac), success, 0);
+    if (!success) NowMetrics::count(counters.sendFailures);
     {
-        printDebug("*** Data sending failed with the following error: " + String(status), 1);
+        std::lock_guard<std::recursive_mutex> lock(txLock);
+        relays.linkResult(mac, success);
+        txQueue.sendDone(success);
+        pumpTx();
+    }
+    printDebug("(onSent) data send to: " + Helpers::macToString(mac) + ", status: " + String(success), 0);
+    if (!success)
+    {
+        printDebug("*** Data sending failed", 1);
     }
-}
-
-void onReceived(const uint8_t *mac, const uint8_t *incomingData, int len)
-{
-    instance->dataReceived(mac, incomingData, len);
 }
 
 #pragma endregion Callbacks
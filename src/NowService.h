@@ -2,8 +2,26 @@
 #define NOW_SERVICE_H
 
 #include <Arduino.h>
+#include <mutex>
 
 #include "NowMsg.h"
+#include "NowTransport.h"
+#include "Reassembly.h"
+#include "Reliable.h"
+#include "TxQueue.h"
+#include "RxRing.h"
+#include "NowDataView.h"
+#include "NowBatch.h"
+#include "NowLz.h"
+#include "NowMetrics.h"
+#include "NowDiscovery.h"
+#include "TimerHeap.h"
+#include "PeerCache.h"
+#include "NowRelay.h"
+#include "NowGroup.h"
+#include "NowClock.h"
+#include "NowLiveness.h"
+#include "NowTdma.h"
 
 enum ServiceMode : int
 {
@@ -32,29 +50,180 @@ protected:
     using DataReceivedCallback = std::function<void(uint8_t*, int length)>;
     DataReceivedCallback onDataReceived;
 
+    using PeerDataReceivedCallback = std::function<void(const uint8_t *mac, uint8_t *data, int length)>;
+    PeerDataReceivedCallback onPeerDataReceived;
+
+    using DataViewCallback = std::function<void(const NowDataView &view)>;
+    DataViewCallback onDataView;
+    DataViewCallback topics[NOW_TOPICS];
+
+    using SendCompleteCallback = TxQueue::CompleteCallback;
+
     const uint8_t broadcastMac[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
     ServiceRole role = ServiceRole::Client;
 
+    NowTransport *transport = nullptr;
     uint8_t macAddress[6];
     uint8_t boundMac[6];
     int serviceMode = None;
+    int serviceModePrev = None;
+    unsigned long lastTick = 0;
+    uint16_t nextMsgId = 0;
+    ReassemblyPool reassembly;
+    bool reliable = false;
+    ReliableChannel reliableOut;
+    TxQueue txQueue;
+    std::recursive_mutex txLock;
+    RxRing rxRing;
+    RxRing::Slot *rxCurrent = nullptr;
+    TxDoneRing txDone;
+    uint32_t txDoneLost = 0;        //  overruns already failed
+    int32_t rxLatency = -1;         //  of the frame being processed
+    unsigned long heartbeatInterval = NOW_HEARTBEAT_INTERVAL;
+    float suspectDeviations;        //  NowLiveness::deviations(phi)
+    NowClock clock;
+    NowTdma tdma;
+    bool txHeld = false;            //  queued frames wait for our TDMA window
+    unsigned long txResume = 0;     //  ms it opens
+    TimerHeap timers;
+    unsigned long batchDelay = 0;
+    uint8_t batchMac[6];
+    uint8_t batchBuffer[NOW_MAX_PAYLOAD];
+    int batchLength = 0;
+    int batchCount = 0;
+    uint8_t batchFlags = 0;
+    NowTraffic batchTraffic = NOW_TRAFFIC_REALTIME;
+    unsigned long batchDue = 0;
+    bool compression = false;
+    NowLz lz;
+    uint8_t publishBuffer[NOW_TOPIC_PREFIX + NOW_PUBLISH_MAX];
+    NowMetrics counters;
+    PeerCache peers;
+    RelayTable relays;
+    bool relay = false;
+    uint32_t randomState = 1;
 
     void readMacAddress();
+    //  0..range-1, for spreading out timers - not for anything secret
+    uint32_t nextRandom(uint32_t range);
     void worker();
+    void processReceived();
+    void processSent();
+    const NowMsg *decodeFrame(const uint8_t *mac, const uint8_t *data, int len, NowMsg &scratch);
+    bool relayFrame(const uint8_t *mac, const NowMsg *m);
+    void forgetRoute(const uint8_t *mac);
+    virtual void peerMetrics(NowMetricsSnapshot &out);
+    unsigned long sleepTime(unsigned long now);
+    //  the next deadline work() has, beyond the timers
+    virtual bool workDue(unsigned long &due);
     virtual void work(unsigned long now, unsigned long ticks);    
     virtual void initialize();
-    bool sendMsg(const uint8_t* mac, const NowMsg& m);
-    void sendHeartbeat(const uint8_t *mac);
-    void addSourceMac(const uint8_t *sourceMac);
+    //  on a TDMA schedule held until our window, when slotted()
+    bool sendMsg(const uint8_t* mac, NowMsg& m, int ticket = -1);
+    bool holdMsg(const uint8_t *mac, const NowMsg &m, int ticket);
+    bool transmitMsg(const uint8_t *mac, NowMsg &m, int ticket);
+    //  every frame waits for its window, one on air at a time
+    virtual bool slotted(uint32_t nowUs);
+    //  µs until a frame of datatype may go on air, 0 = now
+    virtual uint32_t slotWait(uint8_t datatype, uint32_t nowUs);
+    //  carries our micros(), and answering's back when it answers one -
+    //  returns what was sent, 0 if nothing
+    uint32_t sendHeartbeat(const uint8_t *mac, const NowClockSync *answering = nullptr);
+    uint32_t receivedMicros();
+    void sendSolicit(uint16_t window, uint8_t flags = 0);
+    //  registered with the driver now rather than on the first send, and
+    //  held there - see PeerCache
+    void addSourceMac(const uint8_t *sourceMac, PeerHold hold = PEER_BOUND);
     void removeSourceMac(const uint8_t *sourceMac);
+    //  a send callback, on the worker
+    virtual void dataSent(const uint8_t *mac, bool success);
+    void deliverData(const uint8_t *mac, const uint8_t *data, int length, int message = -1, uint8_t flags = 0);
+    void deliverView(NowDataView &view, uint8_t *data);
+    void deliverFrame(const uint8_t *mac, const NowMsg *m);
+    int dataFrames(int length) const;
+    bool buildData(const uint8_t *mac, const uint8_t *data, int length, const std::function<bool(NowMsg &)> &emit, uint8_t flags = 0);
+    //  control frames go straight to the driver, the data classes through
+    //  the send queue
+    bool sendFrames(const uint8_t *mac, const uint8_t *data, int length, uint8_t flags = 0,
+                    NowTraffic traffic = NOW_TRAFFIC_CONTROL);
+    bool queueFrames(const uint8_t *mac, const uint8_t *data, int length, uint8_t flags, SendCompleteCallback done,
+                     NowTraffic traffic);
+    bool queueData(const uint8_t *mac, const uint8_t *data, int length, uint8_t flags, NowTraffic traffic);
+    bool flushBatch();
+    int compressData(const uint8_t *&data, int length, uint8_t &flags, uint8_t *packed);
+    void pumpTx();
+    void fragmentReceived(const uint8_t *mac, const NowMsg *m);
+    virtual PeerLink *peerLink(const uint8_t *mac);
+    bool reliableReceived(const uint8_t *mac, const NowMsg *m, PeerLink *link);
+    void dataAckReceived(const uint8_t *mac, const NowMsg *m, PeerLink *link);
+    void forgetPeer(const uint8_t *mac);
 
 public:
-    NowService();
+    NowService(NowTransport *transport = nullptr);
 
-    ~NowService();
+    virtual ~NowService();
 
+    //  blocking - sets up the service and runs the worker loop
     void initialize(BoundCallback peerBound, DataReceivedCallback dataRecevied);
-    bool sendData(const uint8_t *data, int length);
+    //  non-blocking - sets up the service, the caller drives step()
+    bool begin(BoundCallback peerBound, DataReceivedCallback dataRecevied);
+    //  returns the ms until something is due, frames arriving earlier wake
+    //  the worker through the transport
+    unsigned long step();
+    //  receive data together with the peer that sent it, instead of the
+    //  plain data callback
+    void setPeerDataReceived(PeerDataReceivedCallback peerDataReceived);
+    //  receive data in place without copying, every view must be handed
+    //  back with release() - until then its buffer is not reused, and a
+    //  single-frame view holds back the receive ring behind it
+    void setDataViewReceived(DataViewCallback dataViewReceived);
+    //  any task
+    void release(const NowDataView &view);
+    //  acknowledge and retransmit data sent to bound peers
+    void setReliable(bool enabled);
+    //  pack small messages to the same peer into shared frames, sent once
+    //  full, on flush() or delay ms after the first was queued. 0 = off
+    void setBatching(unsigned long delay = NOW_BATCH_DELAY);
+    bool flush();
+    //  send data frames compressed whenever that makes them smaller
+    void setCompression(bool enabled);
+    //  detection time against airtime - a link quiet for heartbeatInterval
+    //  ms gets a heartbeat, a peer silent for longer than its traffic makes
+    //  likely at the given phi gets probed. Set the same on both ends.
+    void setLiveness(unsigned long heartbeatInterval, float phi = NOW_LIVENESS_PHI);
+    //  real-time and bulk data wait in the send queue behind the protocol's
+    //  own frames and leave as the driver's callbacks make room, real-time
+    //  NOW_TX_WEIGHT_REALTIME frames to every NOW_TX_WEIGHT_BULK of bulk.
+    //  False while the queue is full. Control data, and messages of more
+    //  frames than the queue holds, go straight to the driver.
+    bool sendData(const uint8_t *data, int length, NowTraffic traffic = NOW_TRAFFIC_REALTIME);
+    bool sendData(const uint8_t *mac, const uint8_t *data, int length, NowTraffic traffic = NOW_TRAFFIC_REALTIME);
+    //  views of data published on topic go to its subscriber instead of the
+    //  data callbacks, leased the same way. Set up before begin().
+    bool subscribe(uint8_t topic, DataViewCallback subscriber);
+    void unsubscribe(uint8_t topic);
+    bool publish(uint8_t topic, const uint8_t *data, int length);
+    bool publish(const uint8_t *mac, uint8_t topic, const uint8_t *data, int length);
+    //  queue without waiting for the radio, done reports once every frame
+    //  of the message went out (or was acknowledged, when reliable)
+    bool sendDataAsync(const uint8_t *data, int length, SendCompleteCallback done = nullptr,
+                       NowTraffic traffic = NOW_TRAFFIC_REALTIME);
+    bool sendDataAsync(const uint8_t *mac, const uint8_t *data, int length, SendCompleteCallback done = nullptr,
+                       NowTraffic traffic = NOW_TRAFFIC_REALTIME);
+    //  frames handed to the driver before waiting for its send callback
+    void setMaxInFlight(int frames);
+    int queuedFrames();
+    //  frames dropped because the worker fell behind the radio
+    uint32_t rxOverruns() const;
+    //  any task
+    void metrics(NowMetricsSnapshot &out);
+    //  µs on the server's clock - the server's own, and on a client once
+    //  heartbeats synced it. toNetworkMicros() takes a transport micros()
+    //  reading from earlier, say when a sensor was sampled.
+    bool clockSynced() const;
+    uint32_t networkMicros();
+    uint32_t toNetworkMicros(uint32_t local) const;
+    //  runs on the worker, frames are handed over by the receive callback
     virtual void dataReceived(const uint8_t *mac, const uint8_t *incomingData, int len);
 };
 
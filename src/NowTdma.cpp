@@ -0,0 +1,59 @@
+#include "NowTdma.h"
+
+void NowTdma::start(uint32_t nowUs, const NowTdmaBeacon &beacon)
+{
+    layout = beacon;
+    epoch = nowUs;
+    length = ((uint32_t)beacon.downlink + beacon.contention + (uint32_t)beacon.slotLength * beacon.slots) * 1000;
+    started = length > 0;
+}
+
+void NowTdma::stop()
+{
+    started = false;
+}
+
+bool NowTdma::active(uint32_t nowUs) const
+{
+    return started && ((uint32_t)(nowUs - epoch) < length * NOW_TDMA_BEACONS_MISSED);
+}
+
+int NowTdma::slots() const
+{
+    return layout.slots;
+}
+
+uint32_t NowTdma::superframe() const
+{
+    return length;
+}
+
+uint32_t NowTdma::wait(uint32_t nowUs, int window) const
+{
+    if (!started) return 0;
+    uint32_t from, to;
+    if (window == Downlink)
+    {
+        from = 0;
+        to = layout.downlink;
+    }
+    else if (window == Contention)
+    {
+        from = layout.downlink;
+        to = from + layout.contention;
+    }
+    else
+    {
+        if (window >= layout.slots) return 0;
+        from = layout.downlink + layout.contention + (uint32_t)window * layout.slotLength;
+        to = from + layout.slotLength;
+    }
+    from *= 1000;
+    to *= 1000;
+    //  the last frame has to finish before the window closes
+    uint32_t close = (to - from > NOW_TDMA_GUARD) ? to - NOW_TDMA_GUARD : from + 1;
+    //  superframes go on where the beacons left off
+    uint32_t phase = (uint32_t)(nowUs - epoch) % length;
+    if ((phase >= from) && (phase < close)) return 0;
+    return (from + length - phase) % length;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+
+//  ms the server has to itself after each beacon - its queued data goes out
+//  here, replies to clients still go whenever they are due
+#ifndef NOW_TDMA_DOWNLINK
+#define NOW_TDMA_DOWNLINK 5
+#endif
+
+//  ms after the downlink where clients without a slot advertise and
+//  handshake, contending for the channel as they always did
+#ifndef NOW_TDMA_CONTENTION
+#define NOW_TDMA_CONTENTION 10
+#endif
+
+//  ms each bound client gets to transmit in, once per superframe
+#ifndef NOW_TDMA_SLOT
+#define NOW_TDMA_SLOT 8
+#endif
+
+//  µs before a window closes that no frame starts in - a full frame's
+//  airtime at 1 Mbps and the spread in when the beacon arrived
+#ifndef NOW_TDMA_GUARD
+#define NOW_TDMA_GUARD 3000
+#endif
+
+//  superframes without a beacon before a client sends whenever it likes again
+#ifndef NOW_TDMA_BEACONS_MISSED
+#define NOW_TDMA_BEACONS_MISSED 3
+#endif
+
+//  NOW_DT_BEACON payload, broadcast by the server as every superframe
+//  starts. The header timestamp is when, on the server's clock.
+struct __attribute__((packed)) NowTdmaBeacon {
+    uint16_t downlink;      //  ms
+    uint16_t contention;    //  ms
+    uint16_t slotLength;    //  ms
+    uint8_t slots;          //  client slots that follow, by server session slot
+};
+
+//  a superframe as the last beacon laid it out, on this node's µs clock:
+//
+//    | beacon, downlink | contention | slot 0 | slot 1 | ... | slot n-1 |
+//
+//  The server only sends queued data in the downlink, a client only in the
+//  slot of its session and everything else while it has none, frames that
+//  can't finish in the window wait for the next one.
+class NowTdma
+{
+public:
+    enum Window : int
+    {
+        Downlink = -2,
+        Contention = -1
+        //  0.. client slots
+    };
+
+private:
+    bool started = false;
+    uint32_t epoch = 0;         //  µs the current superframe started
+    uint32_t length = 0;        //  µs
+    NowTdmaBeacon layout{};
+
+public:
+    void start(uint32_t nowUs, const NowTdmaBeacon &beacon);
+    void stop();
+    //  a beacon was heard within the last NOW_TDMA_BEACONS_MISSED superframes
+    bool active(uint32_t nowUs) const;
+    int slots() const;
+    uint32_t superframe() const;
+    //  µs until a frame may start in window, 0 while it is open
+    uint32_t wait(uint32_t nowUs, int window) const;
+};
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+//  topic ids 0..NOW_TOPICS-1, one subscriber slot each
+#ifndef NOW_TOPICS
+#define NOW_TOPICS 32
+#endif
+
+//  largest message publish() takes - it is copied once to prepend the topic
+#ifndef NOW_PUBLISH_MAX
+#define NOW_PUBLISH_MAX 512
+#endif
+
+static_assert(NOW_TOPICS <= 255, "NOW_TOPICS must leave room for NOW_NO_TOPIC");
+
+//  a view of data sent without a topic
+static const uint8_t NOW_NO_TOPIC = 0xff;
+
+//  with NOW_FLAG_TOPIC every message in the frame starts with its topic id
+static const int NOW_TOPIC_PREFIX = 1;
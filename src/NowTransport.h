@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+//  the radio underneath a NowService - ESP-NOW on the device, a simulated
+//  medium on the host
+class NowTransport
+{
+public:
+    using ReceiveCallback = std::function<void(const uint8_t *mac, const uint8_t *data, int len)>;
+    using SentCallback = std::function<void(const uint8_t *mac, bool success)>;
+
+    virtual ~NowTransport() {}
+
+    virtual bool begin(ReceiveCallback onReceive, SentCallback onSent) = 0;
+    virtual bool readMacAddress(uint8_t *mac) = 0;
+    virtual bool send(const uint8_t *mac, const uint8_t *data, int len) = 0;
+    virtual bool hasPeer(const uint8_t *mac) = 0;
+    virtual bool addPeer(const uint8_t *mac, uint8_t channel) = 0;
+    virtual bool removePeer(const uint8_t *mac) = 0;
+    //  the radio channel, peers added with channel 0 follow it
+    virtual bool setChannel(uint8_t channel) { return false; }
+    virtual uint8_t getChannel() { return 0; }
+
+    //  time as seen by this node
+    virtual unsigned long millis() = 0;
+    //  the same clock in µs, for clock sync - ms resolution unless the
+    //  transport has better
+    virtual unsigned long micros() { return millis() * 1000; }
+    //  sleep the worker, returning early once wake() is called
+    virtual void delay(unsigned long ms) = 0;
+    //  called from the driver callbacks when there is work for the worker
+    virtual void wake() = 0;
+};
@@ -0,0 +1,91 @@
+#include <Helpers.h>
+#include "PeerCache.h"
+
+void PeerCache::begin(NowTransport *transport)
+{
+    this->transport = transport;
+    used = 0;
+    uses = 0;
+}
+
+int PeerCache::find(uint64_t key) const
+{
+    for (int i = 0; i < used; i++)
+    {
+        if (entries[i].key == key) return i;
+    }
+    return -1;
+}
+
+int PeerCache::victim() const
+{
+    //  lowest hold first, then least recently used
+    int best = -1;
+    for (int i = 0; i < used; i++)
+    {
+        const Entry &e = entries[i];
+        if (e.hold == PEER_FIXED) continue;
+        if ((best < 0) || (e.hold < entries[best].hold) ||
+            ((e.hold == entries[best].hold) && ((int32_t)(e.lastUsed - entries[best].lastUsed) < 0)))
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+void PeerCache::erase(int i)
+{
+    entries[i] = entries[--used];
+}
+
+bool PeerCache::ensure(const uint8_t *mac, PeerHold hold)
+{
+    uint64_t key = Helpers::macToKey(mac);
+    int i = find(key);
+    if (i >= 0)
+    {
+        entries[i].lastUsed = ++uses;
+        if (hold > entries[i].hold) entries[i].hold = hold;
+        return true;
+    }
+    if (used >= NOW_MAX_PEERS)
+    {
+        int v = victim();
+        if (v < 0) return false;
+        uint8_t victimMac[6];
+        Helpers::keyToMac(entries[v].key, victimMac);
+        transport->removePeer(victimMac);
+        erase(v);
+        evicted++;
+    }
+    //  0 = current channel. A refusal may just mean someone else added it.
+    if (!transport->addPeer(mac, 0) && !transport->hasPeer(mac)) return false;
+    registered++;
+    entries[used++] = {key, ++uses, hold};
+    return true;
+}
+
+void PeerCache::release(const uint8_t *mac)
+{
+    int i = find(Helpers::macToKey(mac));
+    if (i >= 0) entries[i].hold = PEER_TRANSIENT;
+}
+
+bool PeerCache::remove(const uint8_t *mac)
+{
+    int i = find(Helpers::macToKey(mac));
+    if (i < 0) return false;
+    erase(i);
+    return transport->removePeer(mac);
+}
+
+bool PeerCache::contains(const uint8_t *mac) const
+{
+    return find(Helpers::macToKey(mac)) >= 0;
+}
+
+int PeerCache::count() const
+{
+    return used;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "NowTransport.h"
+
+//  peers the driver holds at once - ESP_NOW_MAX_TOTAL_PEER_NUM
+#ifndef NOW_MAX_PEERS
+#define NOW_MAX_PEERS 20
+#endif
+
+//  how hard a peer holds on to its driver registration
+enum PeerHold : uint8_t
+{
+    PEER_TRANSIENT = 0,     //  evicted first
+    PEER_BOUND = 1,         //  evicted only when every other entry is bound
+    PEER_FIXED = 2          //  never evicted
+};
+
+//  mirror of the driver's peer list. Peers are registered on demand before
+//  sending, and the least recently used one makes room once the driver is
+//  full - so a server can cycle through more nodes than the driver holds.
+//  A known peer costs a lookup, never a driver call.
+class PeerCache
+{
+private:
+    struct Entry
+    {
+        uint64_t key;
+        uint32_t lastUsed;
+        PeerHold hold;
+    };
+
+    NowTransport *transport = nullptr;
+    Entry entries[NOW_MAX_PEERS];
+    int used = 0;
+    uint32_t uses = 0;
+
+    int find(uint64_t key) const;
+    int victim() const;
+    void erase(int i);
+
+public:
+    uint32_t registered = 0;    //  driver registrations
+    uint32_t evicted = 0;       //  registrations dropped to make room
+
+    void begin(NowTransport *transport);
+    //  registered with the driver, evicting if needed - false when the
+    //  driver refused or every entry is fixed
+    bool ensure(const uint8_t *mac, PeerHold hold = PEER_TRANSIENT);
+    //  back to transient, if registered
+    void release(const uint8_t *mac);
+    bool remove(const uint8_t *mac);
+    bool contains(const uint8_t *mac) const;
+    int count() const;
+};
@@ -0,0 +1,163 @@
+#include <string.h>
+
+#include "Reassembly.h"
+
+static_assert(NOW_MAX_MESSAGE <= 32 * 8 * NOW_FRAGMENT_DATA, "Reassembly seen bitmap too small");
+
+static const int slotCount = NOW_REASSEMBLY_SLOTS + NOW_EXPAND_SLOTS;
+
+ReassemblyPool::ReassemblyPool()
+{
+    for (int i = 0; i < NOW_REASSEMBLY_SLOTS; i++) slots[i].buffer = messages[i];
+    for (int i = 0; i < NOW_EXPAND_SLOTS; i++) slots[NOW_REASSEMBLY_SLOTS + i].buffer = expanded[i];
+}
+
+ReassemblyPool::Slot *ReassemblyPool::acquire(uint64_t peer, const NowFragment *f, unsigned long now)
+{
+    Slot *free = nullptr;
+    for (int i = 0; i < NOW_REASSEMBLY_SLOTS; i++)
+    {
+        Slot &slot = slots[i];
+        uint8_t state = slot.state.load(std::memory_order_acquire);
+        if (state == Leased) continue;
+        if ((state == Filling) && (slot.peer == peer) && (slot.msgId == f->msgId))
+        {
+            //  a reused id with a different shape is a new message
+            if ((slot.totalLength == f->totalLength) && (slot.count == f->count)) return &slot;
+            state = Free;
+        }
+        if ((state == Filling) && (now - slot.lastUpdate >= timeout))
+        {
+            state = Free;
+            expired++;
+        }
+        if (state == Free)
+        {
+            slot.state.store(Free, std::memory_order_relaxed);
+            if (!free) free = &slot;
+        }
+    }
+    if (!free)
+    {
+        //  all buffers busy - let the messages in progress finish rather
+        //  than evicting them and completing nothing
+        dropped++;
+        return nullptr;
+    }
+    free->state.store(Filling, std::memory_order_relaxed);
+    free->peer = peer;
+    free->msgId = f->msgId;
+    free->totalLength = f->totalLength;
+    free->count = f->count;
+    free->received = 0;
+    memset(free->seen, 0, sizeof(free->seen));
+    return free;
+}
+
+int ReassemblyPool::add(uint64_t peer, const NowMsg &m, unsigned long now)
+{
+    if (!validateFragment(m)) return -1;
+    const NowFragment *f = reinterpret_cast<const NowFragment *>(m.payload);
+
+    Slot *slot = acquire(peer, f, now);
+    if (!slot) return -1;
+    slot->lastUpdate = now;
+    uint8_t bit = (uint8_t)(1 << (f->index & 7));
+    if (slot->seen[f->index >> 3] & bit) return -1;
+    slot->seen[f->index >> 3] |= bit;
+    memcpy(slot->buffer + (size_t)f->index * NOW_FRAGMENT_DATA, f->data, m.length - NOW_FRAGMENT_HEADER);
+    if (++slot->received < slot->count) return -1;
+    return (int)(slot - slots);
+}
+
+int ReassemblyPool::claim(unsigned long now)
+{
+    for (int i = NOW_REASSEMBLY_SLOTS; i < slotCount; i++)
+    {
+        Slot &slot = slots[i];
+        uint8_t state = slot.state.load(std::memory_order_acquire);
+        if ((state == Filling) && (now - slot.lastUpdate >= timeout))
+        {
+            state = Free;
+            expired++;
+        }
+        if (state != Free) continue;
+        slot.state.store(Filling, std::memory_order_relaxed);
+        slot.totalLength = 0;
+        slot.lastUpdate = now;
+        return (int)(&slot - slots);
+    }
+    dropped++;
+    return -1;
+}
+
+uint8_t *ReassemblyPool::buffer(int slot)
+{
+    return slots[slot].buffer;
+}
+
+const uint8_t *ReassemblyPool::data(int slot) const
+{
+    return slots[slot].buffer;
+}
+
+uint16_t ReassemblyPool::length(int slot) const
+{
+    return slots[slot].totalLength;
+}
+
+void ReassemblyPool::setLength(int slot, uint16_t length)
+{
+    slots[slot].totalLength = length;
+}
+
+void ReassemblyPool::done(int slot)
+{
+    if (slots[slot].state.load(std::memory_order_relaxed) == Filling) slots[slot].state.store(Free, std::memory_order_relaxed);
+}
+
+void ReassemblyPool::lease(int slot)
+{
+    slots[slot].leases.fetch_add(1, std::memory_order_relaxed);
+    slots[slot].state.store(Leased, std::memory_order_relaxed);
+}
+
+void ReassemblyPool::release(int slot)
+{
+    if ((slot < 0) || (slot >= slotCount)) return;
+    //  the last lease frees the buffer
+    if (slots[slot].leases.fetch_sub(1, std::memory_order_acq_rel) == 1) slots[slot].state.store(Free, std::memory_order_release);
+}
+
+void ReassemblyPool::expire(unsigned long now)
+{
+    for (Slot &slot : slots)
+    {
+        if (slot.state.load(std::memory_order_relaxed) != Filling) continue;
+        if (now - slot.lastUpdate < timeout) continue;
+        slot.state.store(Free, std::memory_order_relaxed);
+        expired++;
+    }
+}
+
+bool ReassemblyPool::nextDue(unsigned long &at) const
+{
+    bool found = false;
+    for (const Slot &slot : slots)
+    {
+        if (slot.state.load(std::memory_order_relaxed) != Filling) continue;
+        unsigned long due = slot.lastUpdate + timeout;
+        if (!found || ((long)(due - at) < 0)) at = due;
+        found = true;
+    }
+    return found;
+}
+
+void ReassemblyPool::clear()
+{
+    for (Slot &slot : slots)
+    {
+        //  leased messages belong to the application until released
+        if (slot.state.load(std::memory_order_relaxed) == Filling) slot.state.store(Free, std::memory_order_relaxed);
+    }
+}
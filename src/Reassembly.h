@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+#include "NowFragment.h"
+#include "NowLz.h"
+
+//  preallocated buffers for rebuilding fragmented messages - fragments may
+//  arrive in any order and duplicates are ignored. Compressed frames expand
+//  into buffers of their own, leased the same way.
+class ReassemblyPool
+{
+private:
+    enum SlotState : uint8_t
+    {
+        Free,
+        Filling,
+        Leased
+    };
+
+    struct Slot
+    {
+        //  only a leased slot is handed back from another task
+        std::atomic<uint8_t> state{Free};
+        std::atomic<uint8_t> leases{0};
+        uint64_t peer = 0;
+        uint16_t msgId = 0;
+        uint16_t totalLength = 0;
+        uint8_t count = 0;
+        uint8_t received = 0;
+        unsigned long lastUpdate = 0;
+        uint8_t seen[32];
+        uint8_t *buffer = nullptr;
+    };
+
+    //  the reassembly slots first, then the ones claim() hands out
+    Slot slots[NOW_REASSEMBLY_SLOTS + NOW_EXPAND_SLOTS];
+    uint8_t messages[NOW_REASSEMBLY_SLOTS][NOW_MAX_MESSAGE];
+    uint8_t expanded[NOW_EXPAND_SLOTS][NOW_COMPRESS_MAX];
+
+    Slot *acquire(uint64_t peer, const NowFragment *f, unsigned long now);
+
+public:
+    ReassemblyPool();
+
+    unsigned long timeout = NOW_FRAGMENT_TIMEOUT;
+    unsigned long expired = 0;
+    unsigned long dropped = 0;
+
+    //  returns the slot holding the complete message once the last missing
+    //  fragment arrives, -1 otherwise. The caller must call done() on it.
+    int add(uint64_t peer, const NowMsg &m, unsigned long now);
+    //  a NOW_COMPRESS_MAX buffer to expand a compressed frame into, -1 when
+    //  all are busy. The caller must call done() on it.
+    int claim(unsigned long now);
+    uint8_t *buffer(int slot);
+    const uint8_t *data(int slot) const;
+    uint16_t length(int slot) const;
+    void setLength(int slot, uint16_t length);
+    //  the worker is through with a message - freed unless leased
+    void done(int slot);
+    //  keep a complete message past the worker, one release() per lease,
+    //  from any task
+    void lease(int slot);
+    void release(int slot);
+    void expire(unsigned long now);
+    //  earliest expiry of a message in progress
+    bool nextDue(unsigned long &at) const;
+    void clear();
+};
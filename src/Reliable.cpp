@@ -0,0 +1,221 @@
+#include <string.h>
+
+#include "Reliable.h"
+
+#pragma region PeerLink
+
+bool PeerLink::accept(uint16_t seq)
+{
+    uint16_t d = (uint16_t)(seq - rxNext);
+    if (d >= 0x8000) return false;
+    //  beyond the window means the sender gave up on what we're missing
+    while (d > 32)
+    {
+        advance();
+        d = (uint16_t)(seq - rxNext);
+        if (d >= 0x8000) return false;
+    }
+    if (d == 0)
+    {
+        advance();
+        return true;
+    }
+    uint32_t bit = 1UL << (d - 1);
+    if (rxMask & bit) return false;
+    rxMask |= bit;
+    return true;
+}
+
+void PeerLink::advance()
+{
+    //  rxNext is done with - skip over everything already received after it
+    rxNext++;
+    while (rxMask & 1)
+    {
+        rxMask >>= 1;
+        rxNext++;
+    }
+    rxMask >>= 1;
+}
+
+void PeerLink::rttSample(unsigned long rtt)
+{
+    //  RFC 6298 smoothing
+    if (!measured)
+    {
+        srtt = rtt;
+        rttvar = rtt / 2;
+        measured = true;
+    }
+    else
+    {
+        unsigned long delta = (srtt > rtt) ? (srtt - rtt) : (rtt - srtt);
+        rttvar = (3 * rttvar + delta) / 4;
+        srtt = (7 * srtt + rtt) / 8;
+    }
+    rto = srtt + ((4 * rttvar > 1) ? 4 * rttvar : 1);
+    if (rto < NOW_RELIABLE_MIN_RTO) rto = NOW_RELIABLE_MIN_RTO;
+    if (rto > NOW_RELIABLE_MAX_RTO) rto = NOW_RELIABLE_MAX_RTO;
+}
+
+void PeerLink::reset()
+{
+    *this = PeerLink();
+}
+
+#pragma endregion PeerLink
+
+#pragma region ReliableChannel
+
+ReliableChannel::ReliableChannel()
+{
+}
+
+void ReliableChannel::begin(ResendCallback resend, DoneCallback done)
+{
+    this->resend = resend;
+    this->done = done;
+    for (Slot &slot : slots)
+    {
+        slot.used = false;
+    }
+}
+
+bool ReliableChannel::canSend(uint64_t peer, const PeerLink &link, int frames) const
+{
+    int free = 0;
+    uint16_t span = 0;
+    for (const Slot &slot : slots)
+    {
+        if (!slot.used)
+        {
+            free++;
+            continue;
+        }
+        if (slot.peer != peer) continue;
+        uint16_t d = (uint16_t)(link.txSeq - slot.msg.seq);
+        if (d > span) span = d;
+    }
+    //  the receiver only tracks a window past its oldest missing frame
+    return (free >= frames) && (span + frames <= NOW_RELIABLE_WINDOW);
+}
+
+void ReliableChannel::track(uint64_t peer, PeerLink &link, NowMsg &m, unsigned long now, int ticket)
+{
+    m.flags |= NOW_FLAG_RELIABLE;
+    m.seq = link.txSeq++;
+    for (Slot &slot : slots)
+    {
+        if (slot.used) continue;
+        slot.used = true;
+        slot.peer = peer;
+        slot.sentAt = now;
+        slot.rto = link.rto;
+        slot.retries = 0;
+        slot.skipped = 0;
+        slot.ticket = ticket;
+        memcpy(&slot.msg, &m, msgSize(m));
+        return;
+    }
+}
+
+void ReliableChannel::acked(uint64_t peer, PeerLink &link, const NowDataAck &ack, unsigned long now)
+{
+    for (Slot &slot : slots)
+    {
+        if (!slot.used || (slot.peer != peer)) continue;
+        uint16_t d = (uint16_t)(slot.msg.seq - ack.next);
+        bool received = (d >= 0x8000) || ((d >= 1) && (d <= 32) && (ack.mask & (1UL << (d - 1))));
+        if (received)
+        {
+            //  Karn - only frames sent once give a usable sample, and only
+            //  from their own ack so lost acks don't inflate it
+            if ((slot.retries == 0) && (slot.msg.seq == ack.echo)) link.rttSample(now - slot.sentAt);
+            slot.used = false;
+            if (done) done(slot.ticket, true);
+            continue;
+        }
+        //  later frames got through - three of those and this one is lost.
+        //  Only once, the retransmission is queued behind a window of acks.
+        if ((d < 32) && (ack.mask >> d) && (slot.skipped < 3) && (++slot.skipped == 3))
+        {
+            retransmit(slot, now);
+        }
+    }
+}
+
+void ReliableChannel::poll(unsigned long now)
+{
+    for (Slot &slot : slots)
+    {
+        if (!slot.used || (now - slot.sentAt < slot.rto)) continue;
+        //  like TCP only the oldest frame times out, anything queued behind
+        //  it is waiting on the same acks
+        if (!isOldest(slot)) continue;
+        if (slot.retries >= NOW_RELIABLE_RETRIES)
+        {
+            slot.used = false;
+            failures++;
+            if (done) done(slot.ticket, false);
+            continue;
+        }
+        slot.rto = (slot.rto * 2 < NOW_RELIABLE_MAX_RTO) ? slot.rto * 2 : NOW_RELIABLE_MAX_RTO;
+        slot.skipped = 0;
+        retransmit(slot, now);
+    }
+}
+
+bool ReliableChannel::nextDue(unsigned long &at) const
+{
+    bool found = false;
+    for (const Slot &slot : slots)
+    {
+        //  only what poll() acts on - a frame behind an unexpired older
+        //  one would be due forever and keep the worker spinning
+        if (!slot.used || !isOldest(slot)) continue;
+        unsigned long due = slot.sentAt + slot.rto;
+        if (!found || ((long)(due - at) < 0)) at = due;
+        found = true;
+    }
+    return found;
+}
+
+bool ReliableChannel::isOldest(const Slot &slot) const
+{
+    for (const Slot &other : slots)
+    {
+        if (!other.used || (other.peer != slot.peer) || (&other == &slot)) continue;
+        if ((uint16_t)(slot.msg.seq - other.msg.seq) < 0x8000) return false;
+    }
+    return true;
+}
+
+void ReliableChannel::retransmit(Slot &slot, unsigned long now)
+{
+    slot.retries++;
+    slot.sentAt = now;
+    retransmits++;
+    if (resend) resend(slot.msg);
+}
+
+void ReliableChannel::forget(uint64_t peer)
+{
+    for (Slot &slot : slots)
+    {
+        if (!slot.used || (slot.peer != peer)) continue;
+        slot.used = false;
+        if (done) done(slot.ticket, false);
+    }
+}
+
+int ReliableChannel::inFlight(uint64_t peer) const
+{
+    int count = 0;
+    for (const Slot &slot : slots)
+    {
+        if (slot.used && (slot.peer == peer)) count++;
+    }
+    return count;
+}
+
+#pragma endregion ReliableChannel
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+#include "NowMsg.h"
+
+//  frames a peer may have outstanding - bounded by the 32-bit selective ack
+#ifndef NOW_RELIABLE_WINDOW
+#define NOW_RELIABLE_WINDOW 32
+#endif
+
+//  retransmission buffers shared by all peers
+#ifndef NOW_RELIABLE_SLOTS
+#define NOW_RELIABLE_SLOTS 32
+#endif
+
+#ifndef NOW_RELIABLE_RETRIES
+#define NOW_RELIABLE_RETRIES 8
+#endif
+
+//  retransmission timeout bounds in ms, the timeout itself follows the RTT
+#ifndef NOW_RELIABLE_MIN_RTO
+#define NOW_RELIABLE_MIN_RTO 10
+#endif
+
+#ifndef NOW_RELIABLE_MAX_RTO
+#define NOW_RELIABLE_MAX_RTO 500
+#endif
+
+static_assert(NOW_RELIABLE_WINDOW <= 32, "NOW_RELIABLE_WINDOW is limited by the selective ack bitmap");
+
+//  NOW_DT_DATA_ACK payload
+struct __attribute__((packed)) NowDataAck {
+    uint16_t next;   //  cumulative - every sequence before this arrived
+    uint32_t mask;   //  bit i set: next + 1 + i arrived
+    uint16_t echo;   //  the sequence this ack answers, for RTT sampling
+};
+
+//  reliability state for one peer, held in its session
+struct PeerLink
+{
+    uint16_t txSeq = 0;
+    uint16_t rxNext = 0;
+    uint32_t rxMask = 0;
+    bool measured = false;
+    unsigned long srtt = 0;
+    unsigned long rttvar = 0;
+    unsigned long rto = 200;
+
+    //  false for duplicates and frames that are no longer expected
+    bool accept(uint16_t seq);
+    void rttSample(unsigned long rtt);
+    void reset();
+
+private:
+    void advance();
+};
+
+//  sender side: keeps unacknowledged frames for retransmission
+class ReliableChannel
+{
+public:
+    using ResendCallback = std::function<bool(NowMsg &m)>;
+    //  ticket handed to track() - acknowledged or given up on
+    using DoneCallback = std::function<void(int ticket, bool success)>;
+
+private:
+    struct Slot
+    {
+        bool used = false;
+        uint64_t peer = 0;
+        unsigned long sentAt = 0;
+        unsigned long rto = 0;
+        uint8_t retries = 0;
+        uint8_t skipped = 0;
+        int ticket = -1;
+        NowMsg msg;
+    };
+
+    Slot slots[NOW_RELIABLE_SLOTS];
+    ResendCallback resend;
+    DoneCallback done;
+
+    void retransmit(Slot &slot, unsigned long now);
+    bool isOldest(const Slot &slot) const;
+
+public:
+    unsigned long retransmits = 0;
+    unsigned long failures = 0;
+
+    ReliableChannel();
+    void begin(ResendCallback resend, DoneCallback done = nullptr);
+
+    //  room for this many more frames to peer
+    bool canSend(uint64_t peer, const PeerLink &link, int frames) const;
+    //  stamps m with the next sequence and keeps a copy until acknowledged
+    void track(uint64_t peer, PeerLink &link, NowMsg &m, unsigned long now, int ticket = -1);
+    void acked(uint64_t peer, PeerLink &link, const NowDataAck &ack, unsigned long now);
+    void poll(unsigned long now);
+    //  earliest retransmission deadline, false with nothing in flight
+    bool nextDue(unsigned long &at) const;
+    void forget(uint64_t peer);
+    int inFlight(uint64_t peer) const;
+};
@@ -0,0 +1,78 @@
+#include <string.h>
+
+#include "RxRing.h"
+
+bool RxRing::push(const uint8_t *mac, const uint8_t *data, int len, unsigned long now, uint32_t nowUs)
+{
+    if ((len <= 0) || (len > (int)ESPNOW_MAX_DATA))
+    {
+        oversized.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) >= NOW_RX_SLOTS)
+    {
+        overruns.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    Slot &slot = slots[t & (NOW_RX_SLOTS - 1)];
+    memcpy(slot.mac, mac, 6);
+    memcpy(slot.data, data, len);
+    slot.len = len;
+    slot.receivedAt = now;
+    slot.receivedUs = nowUs;
+    //  publish the slot contents before the new tail
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+}
+
+RxRing::Slot *RxRing::front()
+{
+    reclaim();
+    if (next == tail.load(std::memory_order_acquire)) return nullptr;
+    return &slots[next & (NOW_RX_SLOTS - 1)];
+}
+
+void RxRing::pop()
+{
+    if (next == tail.load(std::memory_order_acquire)) return;
+    next++;
+    reclaim();
+}
+
+void RxRing::reclaim()
+{
+    //  hand slots back to the producer up to the first one still leased
+    uint32_t h = head.load(std::memory_order_relaxed);
+    while ((h != next) && (slots[h & (NOW_RX_SLOTS - 1)].leases.load(std::memory_order_acquire) == 0))
+    {
+        h++;
+    }
+    head.store(h, std::memory_order_release);
+}
+
+int RxRing::indexOf(const Slot *slot) const
+{
+    return (int)(slot - slots);
+}
+
+bool RxRing::contains(const Slot *slot, const uint8_t *data) const
+{
+    return (data >= slot->data) && (data < slot->data + sizeof(slot->data));
+}
+
+void RxRing::lease(int index)
+{
+    slots[index].leases.fetch_add(1, std::memory_order_relaxed);
+}
+
+void RxRing::release(int index)
+{
+    if ((index < 0) || (index >= NOW_RX_SLOTS)) return;
+    slots[index].leases.fetch_sub(1, std::memory_order_release);
+}
+
+int RxRing::size() const
+{
+    return (int)(tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire));
+}
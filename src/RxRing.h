@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+#include "NowMsg.h"
+
+//  received frames waiting for the worker or leased to the consumer,
+//  power of two
+#ifndef NOW_RX_SLOTS
+#define NOW_RX_SLOTS 16
+#endif
+
+static_assert((NOW_RX_SLOTS & (NOW_RX_SLOTS - 1)) == 0, "NOW_RX_SLOTS must be a power of two");
+
+//  single-producer/single-consumer ring of preallocated frame slots. The
+//  driver callback only copies into it, the worker does the processing.
+//  A processed slot can stay leased to the application, the ring reclaims
+//  it once released.
+class RxRing
+{
+public:
+    struct Slot
+    {
+        uint8_t mac[6];
+        int len;
+        unsigned long receivedAt;
+        uint32_t receivedUs;                //  transport micros()
+        std::atomic<uint8_t> leases{0};     //  one per view into the slot
+        uint8_t data[ESPNOW_MAX_DATA];
+    };
+
+private:
+    Slot slots[NOW_RX_SLOTS];
+    std::atomic<uint32_t> head{0};   //  oldest slot still in use
+    uint32_t next = 0;               //  next slot for the worker
+    std::atomic<uint32_t> tail{0};   //  producer
+
+    void reclaim();
+
+public:
+    std::atomic<uint32_t> overruns{0};
+    std::atomic<uint32_t> oversized{0};
+
+    //  producer side - false when the ring is full or the frame too big
+    bool push(const uint8_t *mac, const uint8_t *data, int len, unsigned long now, uint32_t nowUs);
+    //  consumer side - the slot stays valid until pop(), or release() when
+    //  it was leased
+    Slot *front();
+    void pop();
+    int indexOf(const Slot *slot) const;
+    bool contains(const Slot *slot, const uint8_t *data) const;
+    void lease(int index);
+    //  any task
+    void release(int index);
+    int size() const;
+};
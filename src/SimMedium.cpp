@@ -0,0 +1,383 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#include <Helpers.h>
+#include "SimMedium.h"
+
+static const uint8_t simBroadcastMac[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+#pragma region SimTransport
+
+SimTransport::SimTransport(SimMedium *medium, const uint8_t *mac, uint8_t channel)
+    : medium(medium), channel(channel)
+{
+    memcpy(this->mac, mac, 6);
+}
+
+bool SimTransport::begin(ReceiveCallback onReceive, SentCallback onSent)
+{
+    this->onReceive = onReceive;
+    this->onSent = onSent;
+    return true;
+}
+
+bool SimTransport::readMacAddress(uint8_t *mac)
+{
+    memcpy(mac, this->mac, 6);
+    return true;
+}
+
+bool SimTransport::send(const uint8_t *mac, const uint8_t *data, int len)
+{
+    //  like the driver, refuse unknown peers and oversized frames
+    if (!knows(mac) || (len <= 0) || (len > 250))
+    {
+        medium->stats.sendFailures++;
+        return false;
+    }
+    return medium->transmit(this, mac, data, len);
+}
+
+bool SimTransport::knows(const uint8_t *mac) const
+{
+    return std::find(peers.begin(), peers.end(), Helpers::macToKey(mac)) != peers.end();
+}
+
+bool SimTransport::hasPeer(const uint8_t *mac)
+{
+    medium->stats.peerCalls++;
+    return knows(mac);
+}
+
+bool SimTransport::addPeer(const uint8_t *mac, uint8_t channel)
+{
+    medium->stats.peerCalls++;
+    //  0 = current channel, anything else has to match the radio
+    if ((channel != 0) && (channel != this->channel)) return false;
+    //  the driver's table is full or already has it
+    if (((int)peers.size() >= medium->config.maxPeers) || knows(mac)) return false;
+    peers.push_back(Helpers::macToKey(mac));
+    return true;
+}
+
+bool SimTransport::removePeer(const uint8_t *mac)
+{
+    medium->stats.peerCalls++;
+    auto it = std::find(peers.begin(), peers.end(), Helpers::macToKey(mac));
+    if (it == peers.end()) return false;
+    peers.erase(it);
+    return true;
+}
+
+bool SimTransport::setChannel(uint8_t channel)
+{
+    if ((channel < 1) || (channel > 14)) return false;
+    this->channel = channel;
+    return true;
+}
+
+uint8_t SimTransport::getChannel()
+{
+    return channel;
+}
+
+unsigned long SimTransport::millis()
+{
+    return medium->millis();
+}
+
+unsigned long SimTransport::micros()
+{
+    uint64_t now = medium->micros();
+    return (unsigned long)((int64_t)now + clockOffsetUs + (int64_t)((double)now * clockDriftPpm / 1e6));
+}
+
+void SimTransport::delay(unsigned long ms)
+{
+    medium->advance(ms);
+}
+
+void SimTransport::wake()
+{
+    woken = true;
+}
+
+bool SimTransport::takeWake()
+{
+    bool was = woken;
+    woken = false;
+    return was;
+}
+
+void SimTransport::setPosition(float x, float y)
+{
+    this->x = x;
+    this->y = y;
+}
+
+void SimTransport::setClock(int64_t offsetUs, float driftPpm)
+{
+    clockOffsetUs = offsetUs;
+    clockDriftPpm = driftPpm;
+}
+
+#pragma endregion SimTransport
+
+#pragma region SimMedium
+
+SimMedium::SimMedium(uint32_t seed)
+    : seed(seed ? (0x9e3779b97f4a7c15ULL ^ seed) : 1)
+{
+}
+
+SimTransport *SimMedium::createNode(const uint8_t *mac, uint8_t channel)
+{
+    nodes.emplace_back(new SimTransport(this, mac, channel));
+    return nodes.back().get();
+}
+
+SimTransport *SimMedium::findNode(const uint8_t *mac)
+{
+    for (auto &node : nodes)
+    {
+        if (memcmp(node->mac, mac, 6) == 0) return node.get();
+    }
+    return nullptr;
+}
+
+uint64_t SimMedium::micros() const
+{
+    return nowUs;
+}
+
+unsigned long SimMedium::millis() const
+{
+    return (unsigned long)(nowUs / 1000);
+}
+
+uint32_t SimMedium::nextRandom()
+{
+    //  xorshift64* - deterministic for a given seed
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return (uint32_t)((seed * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+float SimMedium::random()
+{
+    return (nextRandom() >> 8) / 16777216.0f;
+}
+
+unsigned long SimMedium::latency()
+{
+    if (config.latencyMaxUs <= config.latencyMinUs) return config.latencyMinUs;
+    return config.latencyMinUs + nextRandom() % (config.latencyMaxUs - config.latencyMinUs + 1);
+}
+
+void SimMedium::schedule(SimTransport *from, SimTransport *to, const uint8_t *toMac, const uint8_t *data, int len, uint64_t deliverAt, bool success)
+{
+    Frame frame;
+    frame.deliverAt = deliverAt;
+    frame.order = order++;
+    frame.from = from;
+    frame.to = to;
+    memcpy(frame.fromMac, from->mac, 6);
+    memcpy(frame.toMac, toMac, 6);
+    frame.channel = from->channel;
+    frame.success = success;
+    if (data && (len > 0)) frame.data.assign(data, data + len);
+    frames.push(std::move(frame));
+}
+
+bool SimMedium::inRange(const SimTransport *a, const SimTransport *b) const
+{
+    if (config.range <= 0.0f) return true;
+    float dx = a->x - b->x;
+    float dy = a->y - b->y;
+    return dx * dx + dy * dy <= config.range * config.range;
+}
+
+unsigned long SimMedium::airtime(int len) const
+{
+    return config.frameOverheadUs + (unsigned long)((uint64_t)len * 8 * 1000000 / (config.bitRate ? config.bitRate : 1));
+}
+
+bool SimMedium::transmit(SimTransport *from, const uint8_t *toMac, const uint8_t *data, int len)
+{
+    if (config.contentionSlots)
+    {
+        //  goes on air once it wins a contention round
+        Pending frame;
+        frame.from = from;
+        memcpy(frame.toMac, toMac, 6);
+        frame.channel = from->channel;
+        frame.requestedAt = nowUs;
+        frame.data.assign(data, data + len);
+        pending[from->channel % 15].push_back(std::move(frame));
+        return true;
+    }
+
+    //  one frame at a time per channel
+    unsigned long air = airtime(len);
+    uint64_t &busy = channelBusy[from->channel % 15];
+    uint64_t start = (busy > nowUs) ? busy : nowUs;
+    busy = start + air;
+    stats.airtimeUs += air;
+    emit(from, from->channel, toMac, data, len, start);
+    return true;
+}
+
+void SimMedium::emit(SimTransport *from, uint8_t channel, const uint8_t *toMac, const uint8_t *data, int len, uint64_t start)
+{
+    unsigned long air = airtime(len);
+    stats.framesSent++;
+    stats.bytesOnAir += len;
+
+    bool broadcast = memcmp(toMac, simBroadcastMac, 6) == 0;
+    bool delivered = false;
+    for (auto &node : nodes)
+    {
+        SimTransport *to = node.get();
+        if ((to == from) || (to->channel != channel)) continue;
+        if (!broadcast && (memcmp(to->mac, toMac, 6) != 0)) continue;
+        if (!inRange(from, to)) continue;
+        if (random() < config.lossRate)
+        {
+            stats.framesLost++;
+            continue;
+        }
+        delivered = true;
+        //  a radio delivers its own frames in order
+        uint64_t at = start + air + latency();
+        if (at < from->lastDelivery) at = from->lastDelivery;
+        from->lastDelivery = at;
+        schedule(from, to, toMac, data, len, at, true);
+        if (random() < config.duplicateRate)
+        {
+            stats.framesDuplicated++;
+            schedule(from, to, toMac, data, len, at + latency(), true);
+        }
+    }
+    //  unicast is acknowledged at the MAC layer, broadcast always "succeeds"
+    schedule(from, nullptr, toMac, nullptr, 0, start + air + config.latencyMinUs, broadcast || delivered);
+}
+
+uint64_t SimMedium::nextRound(int &channel) const
+{
+    uint64_t next = UINT64_MAX;
+    for (int i = 0; i < 15; i++)
+    {
+        for (const Pending &frame : pending[i])
+        {
+            uint64_t at = (channelBusy[i] > frame.requestedAt) ? channelBusy[i] : frame.requestedAt;
+            if (at >= next) continue;
+            next = at;
+            channel = i;
+        }
+    }
+    return next;
+}
+
+void SimMedium::contend(int channel, uint64_t at)
+{
+    //  every frame waiting for the channel draws a backoff slot, the lowest
+    //  slot transmits - and when several drew it, they all collide
+    std::vector<Pending> &waiting = pending[channel];
+    std::vector<size_t> winners;
+    unsigned long lowest = ULONG_MAX;
+    for (size_t i = 0; i < waiting.size(); i++)
+    {
+        if (waiting[i].requestedAt > at) continue;
+        //  the window doubles with every retry
+        int shift = (waiting[i].retries < 6) ? waiting[i].retries : 6;
+        unsigned long slot = nextRandom() % (config.contentionSlots << shift);
+        if (slot > lowest) continue;
+        if (slot < lowest) winners.clear();
+        lowest = slot;
+        winners.push_back(i);
+    }
+    uint64_t start = at + (uint64_t)lowest * config.slotUs;
+    unsigned long air = 0;
+    for (size_t i : winners) air = std::max(air, airtime((int)waiting[i].data.size()));
+    channelBusy[channel] = start + air;
+    stats.airtimeUs += air;
+
+    std::vector<bool> done(waiting.size(), false);
+    for (size_t i : winners)
+    {
+        Pending &frame = waiting[i];
+        if (winners.size() == 1)
+        {
+            emit(frame.from, frame.channel, frame.toMac, frame.data.data(), (int)frame.data.size(), start);
+            done[i] = true;
+            continue;
+        }
+        stats.framesSent++;
+        stats.framesCollided++;
+        stats.bytesOnAir += frame.data.size();
+        bool broadcast = memcmp(frame.toMac, simBroadcastMac, 6) == 0;
+        //  the MAC retries unicast that wasn't acknowledged, broadcast is gone
+        if (!broadcast && (frame.retries++ < config.macRetries)) continue;
+        schedule(frame.from, nullptr, frame.toMac, nullptr, 0, start + air + config.latencyMinUs, broadcast);
+        done[i] = true;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < waiting.size(); i++)
+    {
+        if (done[i]) continue;
+        if (kept != i) waiting[kept] = std::move(waiting[i]);
+        kept++;
+    }
+    waiting.resize(kept);
+}
+
+void SimMedium::advance(unsigned long ms)
+{
+    advanceMicros((uint64_t)ms * 1000);
+}
+
+void SimMedium::advanceMicros(uint64_t us)
+{
+    uint64_t until = nowUs + us;
+    while (true)
+    {
+        int channel = 0;
+        uint64_t round = nextRound(channel);
+        uint64_t next = frames.empty() ? UINT64_MAX : frames.top().deliverAt;
+        if ((round <= next) && (round <= until))
+        {
+            nowUs = round;
+            contend(channel, round);
+            continue;
+        }
+        if (next > until) break;
+        Frame frame = frames.top();
+        frames.pop();
+        nowUs = frame.deliverAt;
+        if (frame.to)
+        {
+            //  a receiver that hopped channel in the meantime misses the frame
+            if (frame.to->channel != frame.channel) continue;
+            stats.framesDelivered++;
+            if (frame.to->onReceive) frame.to->onReceive(frame.fromMac, frame.data.data(), (int)frame.data.size());
+        }
+        else if (frame.from->onSent)
+        {
+            frame.from->onSent(frame.toMac, frame.success);
+        }
+    }
+    nowUs = until;
+}
+
+bool SimMedium::idle() const
+{
+    for (const std::vector<Pending> &waiting : pending)
+    {
+        if (!waiting.empty()) return false;
+    }
+    return frames.empty();
+}
+
+#pragma endregion SimMedium
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <queue>
+#include <vector>
+
+#include "NowTransport.h"
+
+//  link behaviour applied to every frame on the simulated medium
+struct SimLinkConfig
+{
+    unsigned long latencyMinUs = 1000;
+    unsigned long latencyMaxUs = 2000;
+    float lossRate = 0.0f;       //  0..1, per receiver
+    float duplicateRate = 0.0f;  //  0..1, per delivered frame
+    unsigned long bitRate = 1000000;  //  ESP-NOW default 1 Mbps
+    unsigned long frameOverheadUs = 300; //  preamble, MAC header, vendor IE
+    //  CSMA/CA - frames waiting for the channel draw one of this many
+    //  backoff slots and collide when they draw the same. 0 = frames are
+    //  queued behind each other and never collide
+    unsigned long contentionSlots = 0;
+    unsigned long slotUs = 9;
+    int macRetries = 4;          //  unicast resent after a collision
+    int maxPeers = 20;           //  per node, ESP_NOW_MAX_TOTAL_PEER_NUM
+    //  nodes further apart than this don't hear each other, 0 = everyone
+    //  does. Contention stays shared by the whole channel.
+    float range = 0.0f;
+};
+
+struct SimStats
+{
+    unsigned long framesSent = 0;
+    unsigned long framesDelivered = 0;
+    unsigned long framesLost = 0;
+    unsigned long framesDuplicated = 0;
+    unsigned long sendFailures = 0;
+    unsigned long framesCollided = 0;
+    unsigned long peerCalls = 0;     //  hasPeer, addPeer and removePeer
+    unsigned long long bytesOnAir = 0;
+    unsigned long long airtimeUs = 0;
+};
+
+class SimMedium;
+
+//  one simulated radio attached to a SimMedium
+class SimTransport : public NowTransport
+{
+private:
+    SimMedium *medium;
+    uint8_t mac[6];
+    uint8_t channel;
+    float x = 0.0f;
+    float y = 0.0f;
+    int64_t clockOffsetUs = 0;
+    float clockDriftPpm = 0.0f;
+    uint64_t lastDelivery = 0;
+    bool woken = false;
+    std::vector<uint64_t> peers;
+    ReceiveCallback onReceive;
+    SentCallback onSent;
+
+    friend class SimMedium;
+
+    bool knows(const uint8_t *mac) const;
+
+public:
+    SimTransport(SimMedium *medium, const uint8_t *mac, uint8_t channel);
+
+    bool begin(ReceiveCallback onReceive, SentCallback onSent) override;
+    bool readMacAddress(uint8_t *mac) override;
+    bool send(const uint8_t *mac, const uint8_t *data, int len) override;
+    bool hasPeer(const uint8_t *mac) override;
+    bool addPeer(const uint8_t *mac, uint8_t channel) override;
+    bool removePeer(const uint8_t *mac) override;
+    bool setChannel(uint8_t channel) override;
+    uint8_t getChannel() override;
+
+    unsigned long millis() override;
+    unsigned long micros() override;
+    void delay(unsigned long ms) override;
+    void wake() override;
+
+    //  true once after wake() - lets a harness run the node's worker early
+    bool takeWake();
+    //  where the node is, for SimLinkConfig::range
+    void setPosition(float x, float y);
+    //  skew what micros() reads against the medium, for clock sync - the
+    //  node's scheduling stays on medium time
+    void setClock(int64_t offsetUs, float driftPpm);
+};
+
+//  in-process radio medium - frames are delivered in virtual time, so any
+//  number of nodes can share one process deterministically
+class SimMedium
+{
+private:
+    struct Frame
+    {
+        uint64_t deliverAt;
+        uint64_t order;
+        SimTransport *from;
+        SimTransport *to;       //  nullptr for a send report
+        uint8_t fromMac[6];
+        uint8_t toMac[6];
+        uint8_t channel;
+        bool success;
+        std::vector<uint8_t> data;
+    };
+    struct Pending
+    {
+        SimTransport *from;
+        uint8_t toMac[6];
+        uint8_t channel;
+        uint64_t requestedAt;
+        int retries = 0;
+        std::vector<uint8_t> data;
+    };
+    struct FrameLater
+    {
+        bool operator()(const Frame &a, const Frame &b) const
+        {
+            return (a.deliverAt != b.deliverAt) ? (a.deliverAt > b.deliverAt) : (a.order > b.order);
+        }
+    };
+
+    std::vector<std::unique_ptr<SimTransport>> nodes;
+    std::priority_queue<Frame, std::vector<Frame>, FrameLater> frames;
+    uint64_t nowUs = 0;
+    uint64_t order = 0;
+    uint64_t channelBusy[15] = {0};
+    std::vector<Pending> pending[15];
+    uint64_t seed;
+
+    uint32_t nextRandom();
+    unsigned long latency();
+    void schedule(SimTransport *from, SimTransport *to, const uint8_t *toMac, const uint8_t *data, int len, uint64_t deliverAt, bool success);
+
+    friend class SimTransport;
+    bool transmit(SimTransport *from, const uint8_t *toMac, const uint8_t *data, int len);
+    void emit(SimTransport *from, uint8_t channel, const uint8_t *toMac, const uint8_t *data, int len, uint64_t start);
+    uint64_t nextRound(int &channel) const;
+    bool inRange(const SimTransport *a, const SimTransport *b) const;
+    void contend(int channel, uint64_t at);
+
+public:
+    SimLinkConfig config;
+    SimStats stats;
+
+    SimMedium(uint32_t seed = 1);
+
+    //  the medium owns its nodes
+    SimTransport *createNode(const uint8_t *mac, uint8_t channel = 1);
+    SimTransport *findNode(const uint8_t *mac);
+
+    uint64_t micros() const;
+    unsigned long millis() const;
+    float random();
+
+    unsigned long airtime(int len) const;
+
+    //  move virtual time forward, delivering every frame that falls due
+    void advance(unsigned long ms);
+    void advanceMicros(uint64_t us);
+    bool idle() const;
+};
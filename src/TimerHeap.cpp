@@ -0,0 +1,100 @@
+#include "TimerHeap.h"
+
+int TimerHeap::add(Callback callback)
+{
+    if (timerCount >= NOW_TIMERS) return -1;
+    timers[timerCount].callback = callback;
+    return timerCount++;
+}
+
+bool TimerHeap::before(int a, int b) const
+{
+    return (long)(timers[a].at - timers[b].at) < 0;
+}
+
+void TimerHeap::place(int position, int id)
+{
+    heap[position] = (int16_t)id;
+    timers[id].position = (int16_t)position;
+}
+
+void TimerHeap::siftUp(int position)
+{
+    int id = heap[position];
+    while (position > 0)
+    {
+        int parent = (position - 1) / 2;
+        if (!before(id, heap[parent])) break;
+        place(position, heap[parent]);
+        position = parent;
+    }
+    place(position, id);
+}
+
+void TimerHeap::siftDown(int position)
+{
+    int id = heap[position];
+    while (true)
+    {
+        int child = 2 * position + 1;
+        if (child >= heapSize) break;
+        if ((child + 1 < heapSize) && before(heap[child + 1], heap[child])) child++;
+        if (!before(heap[child], id)) break;
+        place(position, heap[child]);
+        position = child;
+    }
+    place(position, id);
+}
+
+void TimerHeap::arm(int id, unsigned long at)
+{
+    if ((id < 0) || (id >= timerCount)) return;
+    Timer &timer = timers[id];
+    timer.at = at;
+    if (timer.position < 0)
+    {
+        place(heapSize++, id);
+        siftUp(heapSize - 1);
+        return;
+    }
+    //  moved either way
+    siftUp(timer.position);
+    siftDown(timer.position);
+}
+
+void TimerHeap::cancel(int id)
+{
+    if (!armed(id)) return;
+    int position = timers[id].position;
+    timers[id].position = -1;
+    if (--heapSize == position) return;
+    int moved = heap[heapSize];
+    place(position, moved);
+    siftUp(position);
+    siftDown(timers[moved].position);
+}
+
+bool TimerHeap::armed(int id) const
+{
+    return (id >= 0) && (id < timerCount) && (timers[id].position >= 0);
+}
+
+bool TimerHeap::next(unsigned long &at) const
+{
+    if (heapSize == 0) return false;
+    at = timers[heap[0]].at;
+    return true;
+}
+
+int TimerHeap::run(unsigned long now)
+{
+    int fired = 0;
+    while ((heapSize > 0) && ((long)(timers[heap[0]].at - now) <= 0))
+    {
+        int id = heap[0];
+        cancel(id);
+        fired++;
+        if (timers[id].callback) timers[id].callback(now);
+    }
+    return fired;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+#include "ClientTable.h"
+
+//  service timers plus one per client session
+#ifndef NOW_TIMERS
+#define NOW_TIMERS (8 + NOW_MAX_CLIENTS)
+#endif
+
+//  longest the worker sleeps with nothing scheduled, in ms
+#ifndef NOW_MAX_SLEEP
+#define NOW_MAX_SLEEP 60000
+#endif
+
+//  preallocated timers ordered by deadline in a binary min-heap. Deadlines
+//  are millis() values and compared wrap-safe.
+class TimerHeap
+{
+public:
+    using Callback = std::function<void(unsigned long now)>;
+
+private:
+    struct Timer
+    {
+        Callback callback;
+        unsigned long at = 0;
+        int16_t position = -1;     //  index in heap, -1 when not armed
+    };
+
+    Timer timers[NOW_TIMERS];
+    int16_t heap[NOW_TIMERS];
+    int timerCount = 0;
+    int heapSize = 0;
+
+    bool before(int a, int b) const;
+    void place(int position, int id);
+    void siftUp(int position);
+    void siftDown(int position);
+
+public:
+    //  returns the timer id, -1 when all timers are taken
+    int add(Callback callback);
+    //  (re)schedule, an armed timer moves to the new deadline
+    void arm(int id, unsigned long at);
+    void cancel(int id);
+    bool armed(int id) const;
+    //  earliest deadline, false when nothing is armed
+    bool next(unsigned long &at) const;
+    //  fires every timer due at now, a callback may arm timers again
+    int run(unsigned long now);
+};
@@ -0,0 +1,196 @@
+#include <string.h>
+
+#include "TxQueue.h"
+
+static const uint8_t weights[NOW_TRAFFIC_CLASSES] = {0, NOW_TX_WEIGHT_REALTIME, NOW_TX_WEIGHT_BULK};
+
+TxQueue::TxQueue()
+{
+    clear();
+}
+
+int TxQueue::size() const
+{
+    return count;
+}
+
+int TxQueue::size(NowTraffic traffic) const
+{
+    return (traffic < NOW_TRAFFIC_CLASSES) ? rings[traffic].count : 0;
+}
+
+int TxQueue::freeFrames(NowTraffic traffic) const
+{
+    int free = NOW_TX_QUEUE - count;
+    if (traffic == NOW_TRAFFIC_BULK) free -= NOW_TX_RESERVED;
+    return (free > 0) ? free : 0;
+}
+
+int TxQueue::inFlight() const
+{
+    return recordCount;
+}
+
+bool TxQueue::canTransmit() const
+{
+    return (count > 0) && (recordCount < maxInFlight);
+}
+
+int TxQueue::open(CompleteCallback done, int frames, NowTraffic traffic)
+{
+    //  frames in flight hold on to theirs too
+    int reserved = (traffic == NOW_TRAFFIC_BULK) ? NOW_TX_RESERVED : 0;
+    if (ticketsUsed + reserved >= NOW_TX_QUEUE) return -1;
+    for (int i = 0; i < NOW_TX_QUEUE; i++)
+    {
+        Ticket &ticket = tickets[i];
+        if (ticket.used) continue;
+        ticket.used = true;
+        ticket.ok = true;
+        ticket.left = (uint8_t)frames;
+        ticket.done = done;
+        ticketsUsed++;
+        return i;
+    }
+    return -1;
+}
+
+TxQueue::Frame *TxQueue::push(NowTraffic traffic)
+{
+    if ((traffic >= NOW_TRAFFIC_CLASSES) || (freeCount == 0)) return nullptr;
+    Ring &ring = rings[traffic];
+    int8_t index = freeList[--freeCount];
+    ring.frames[(ring.head + ring.count) % NOW_TX_QUEUE] = index;
+    ring.count++;
+    count++;
+    return &frames[index];
+}
+
+TxQueue::Frame *TxQueue::front(uint8_t skip)
+{
+    current = -1;
+    if (!(skip & (1 << NOW_TRAFFIC_CONTROL)) && rings[NOW_TRAFFIC_CONTROL].count) current = NOW_TRAFFIC_CONTROL;
+    else
+    {
+        //  weighted round robin, a new round once every waiting class used
+        //  its frames
+        for (int pass = 0; (pass < 2) && (current < 0); pass++)
+        {
+            bool waiting = false;
+            for (int traffic = NOW_TRAFFIC_REALTIME; traffic < NOW_TRAFFIC_CLASSES; traffic++)
+            {
+                if ((skip & (1 << traffic)) || !rings[traffic].count) continue;
+                waiting = true;
+                if (!credits[traffic]) continue;
+                current = traffic;
+                break;
+            }
+            if (!waiting) break;
+            if (current < 0) memcpy(credits, weights, sizeof(credits));
+        }
+    }
+    if (current < 0) return nullptr;
+    const Ring &ring = rings[current];
+    return &frames[ring.frames[ring.head]];
+}
+
+NowTraffic TxQueue::frontTraffic() const
+{
+    return (NowTraffic)current;
+}
+
+void TxQueue::pop()
+{
+    if (current < 0) return;
+    Ring &ring = rings[current];
+    freeList[freeCount++] = ring.frames[ring.head];
+    ring.head = (ring.head + 1) % NOW_TX_QUEUE;
+    ring.count--;
+    count--;
+    if (credits[current]) credits[current]--;
+    current = -1;
+}
+
+void TxQueue::sent(int ticket)
+{
+    if (recordCount >= NOW_TX_SENT_RECORDS)
+    {
+        //  we lose track of this one, so report it done right away
+        recordOverflows++;
+        complete(ticket, true);
+        return;
+    }
+    records[(recordHead + recordCount) % NOW_TX_SENT_RECORDS] = (int8_t)ticket;
+    recordCount++;
+}
+
+void TxQueue::sendDone(bool success)
+{
+    if (recordCount == 0) return;
+    int ticket = records[recordHead];
+    recordHead = (recordHead + 1) % NOW_TX_SENT_RECORDS;
+    recordCount--;
+    complete(ticket, success);
+}
+
+void TxQueue::complete(int ticket, bool success)
+{
+    if ((ticket < 0) || (ticket >= NOW_TX_QUEUE) || !tickets[ticket].used) return;
+    Ticket &t = tickets[ticket];
+    if (!success) t.ok = false;
+    if (t.left > 0) t.left--;
+    if (t.left > 0) return;
+    //  free the ticket first, the callback may queue the next message
+    CompleteCallback done = t.done;
+    bool ok = t.ok;
+    t.used = false;
+    t.done = nullptr;
+    ticketsUsed--;
+    if (done) done(ok);
+}
+
+void TxQueue::clear()
+{
+    for (Ring &ring : rings)
+    {
+        ring.head = 0;
+        ring.count = 0;
+    }
+    for (int i = 0; i < NOW_TX_QUEUE; i++) freeList[i] = (int8_t)(NOW_TX_QUEUE - 1 - i);
+    freeCount = NOW_TX_QUEUE;
+    count = 0;
+    current = -1;
+    memcpy(credits, weights, sizeof(credits));
+    recordHead = 0;
+    recordCount = 0;
+    for (Ticket &ticket : tickets)
+    {
+        ticket.used = false;
+        ticket.done = nullptr;
+    }
+    ticketsUsed = 0;
+}
+
+bool TxDoneRing::push(const uint8_t *mac, bool success)
+{
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) >= NOW_TX_SENT_RECORDS)
+    {
+        overruns.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    Result &result = results[t & (NOW_TX_SENT_RECORDS - 1)];
+    memcpy(result.mac, mac, 6);
+    result.success = success;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+}
+
+bool TxDoneRing::pop(Result &out)
+{
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) return false;
+    out = results[h & (NOW_TX_SENT_RECORDS - 1)];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
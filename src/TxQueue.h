@@ -0,0 +1,155 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+
+#include "NowMsg.h"
+
+//  frames waiting for the radio
+#ifndef NOW_TX_QUEUE
+#define NOW_TX_QUEUE 32
+#endif
+
+//  default number of frames handed to the driver before its send callback
+#ifndef NOW_TX_INFLIGHT
+#define NOW_TX_INFLIGHT 4
+#endif
+
+//  frames handed to the driver that are tracked until their send callback,
+//  including control frames sent outside the queue
+#ifndef NOW_TX_SENT_RECORDS
+#define NOW_TX_SENT_RECORDS 64
+#endif
+
+//  frames of the queue, and completions, bulk data can't take - real-time
+//  data still gets in while a bulk sender keeps the queue full
+#ifndef NOW_TX_RESERVED
+#define NOW_TX_RESERVED 4
+#endif
+
+//  frames a backlogged class sends per round of the data classes
+#ifndef NOW_TX_WEIGHT_REALTIME
+#define NOW_TX_WEIGHT_REALTIME 4
+#endif
+
+#ifndef NOW_TX_WEIGHT_BULK
+#define NOW_TX_WEIGHT_BULK 1
+#endif
+
+static_assert(NOW_TX_QUEUE < 128, "tickets are stored as int8_t");
+static_assert((NOW_TX_SENT_RECORDS & (NOW_TX_SENT_RECORDS - 1)) == 0, "NOW_TX_SENT_RECORDS must be a power of two");
+static_assert(NOW_TX_RESERVED < NOW_TX_QUEUE, "bulk data needs room in the queue");
+
+//  what a message waits behind on its way to the radio
+enum NowTraffic : uint8_t
+{
+    NOW_TRAFFIC_CONTROL,    //  ahead of anything queued, straight to the driver unless queued async
+    NOW_TRAFFIC_REALTIME,   //  readings and commands, most of the data rounds
+    NOW_TRAFFIC_BULK,       //  transfers that only need to get there eventually
+    NOW_TRAFFIC_CLASSES
+};
+
+//  outgoing frames for sendDataAsync and queued traffic classes, gated by
+//  the send callbacks of frames already with the driver. Control frames
+//  leave first, the data classes share what's left by weight. Each class
+//  keeps its order, the frames themselves come from one shared pool.
+class TxQueue
+{
+public:
+    using CompleteCallback = std::function<void(bool success)>;
+
+    struct Frame
+    {
+        NowMsg msg;
+        uint8_t mac[6];
+        bool reliable;
+        int8_t ticket;
+    };
+
+private:
+    struct Ticket
+    {
+        bool used = false;
+        bool ok = true;
+        uint8_t left = 0;
+        CompleteCallback done;
+    };
+
+    struct Ring
+    {
+        int8_t frames[NOW_TX_QUEUE];
+        int head = 0;
+        int count = 0;
+    };
+
+    Frame frames[NOW_TX_QUEUE];
+    int8_t freeList[NOW_TX_QUEUE];
+    int freeCount = 0;
+    Ring rings[NOW_TRAFFIC_CLASSES];
+    int count = 0;
+    //  frames the data classes have left this round
+    uint8_t credits[NOW_TRAFFIC_CLASSES] = {0};
+    int8_t current = -1;    //  class front() picked
+    Ticket tickets[NOW_TX_QUEUE];
+    int ticketsUsed = 0;
+    int8_t records[NOW_TX_SENT_RECORDS];
+    int recordHead = 0;
+    int recordCount = 0;
+
+public:
+    int maxInFlight = NOW_TX_INFLIGHT;
+    unsigned long recordOverflows = 0;
+
+    TxQueue();
+
+    int size() const;
+    int size(NowTraffic traffic) const;
+    int freeFrames(NowTraffic traffic = NOW_TRAFFIC_CONTROL) const;
+    int inFlight() const;
+    bool canTransmit() const;
+
+    //  reserve a completion for a message of this many frames, -1 if none left
+    int open(CompleteCallback done, int frames, NowTraffic traffic = NOW_TRAFFIC_CONTROL);
+    Frame *push(NowTraffic traffic);
+    //  the frame to send next, from none of the classes with bit 1 << class
+    //  set in skip
+    Frame *front(uint8_t skip = 0);
+    NowTraffic frontTraffic() const;
+    //  the frame front() returned is gone
+    void pop();
+
+    //  a frame went to the driver, its callback will follow
+    void sent(int ticket);
+    //  the driver's send callback for the oldest frame sent
+    void sendDone(bool success);
+    //  a frame of the message is finished, the callback fires after the last
+    void complete(int ticket, bool success);
+    void clear();
+};
+
+//  single-producer/single-consumer ring of send results. The driver's send
+//  callback only records them, the worker completes the frames in order.
+class TxDoneRing
+{
+public:
+    struct Result
+    {
+        uint8_t mac[6];
+        bool success;
+    };
+
+private:
+    Result results[NOW_TX_SENT_RECORDS];
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+
+public:
+    //  results lost to a full ring, the worker fails as many frames
+    std::atomic<uint32_t> overruns{0};
+
+    //  producer side
+    bool push(const uint8_t *mac, bool success);
+    //  consumer side
+    bool pop(Result &out);
+};
@@ -14,24 +14,18 @@ uint8_t _macPointer[6];
 std::vector<uint8_t *> peers;
 
 void onPeerFound(String info);
-void onDataReceived(uint8_t *data, int length);
+void onDataView(const NowDataView &view);
 void serviceThread(void *pvParameters);
 
 bool server = false;
 bool bound = false;
 
-typedef struct
-{
-    uint16_t len;
-    uint8_t data[230];
-} rxMsg;
-
 QueueHandle_t rxQ;
 
 void setup()
 {
     Serial.begin(115200);
-    rxQ = xQueueCreate(10, sizeof(rxMsg));
+    rxQ = xQueueCreate(10, sizeof(NowDataView));
     xTaskCreatePinnedToCore(serviceThread, "Worker Loop", 2048, NULL, 1, NULL, 0);
 }
 
@@ -51,14 +45,14 @@ void loop()
         }
 
         //  check for messages in the queue
-        rxMsg msg;
-        if (xQueueReceive(rxQ, &msg, 0) == pdTRUE)
+        NowDataView view;
+        if (xQueueReceive(rxQ, &view, 0) == pdTRUE)
         {
-            char cc[msg.len];
-            memcpy(cc, msg.data, msg.len);
-            Serial.println("**** Data Received! (" + String(msg.len) + ") ****");
-            Serial.println(String(cc));
+            Serial.println("**** Data Received! (" + String(view.length) + ") ****");
+            Serial.write(view.data, view.length);
             Serial.println();
+            //  hand the buffer back to the service
+            service->release(view);
         }
     }
 
@@ -75,7 +69,8 @@ void serviceThread(void *pvParameters)
     {
         service = new NowClient("CLIENT");
     }
-    service->initialize(onPeerFound, onDataReceived);
+    service->setDataViewReceived(onDataView);
+    service->initialize(onPeerFound, nullptr);
 }
 
 void onPeerFound(String info)
@@ -84,12 +79,9 @@ void onPeerFound(String info)
     bound = true;
 }
 
-void onDataReceived(uint8_t *data, int length)
+void onDataView(const NowDataView &view)
 {
-    if (length <= 0)
-        return;
-    rxMsg msg{};
-    msg.len = (length > 230) ? 230 : length;
-    memcpy(msg.data, data, msg.len);
-    xQueueSend(rxQ, &msg, 0);
+    //  the view is leased until released, no need to copy the data
+    if (xQueueSend(rxQ, &view, 0) != pdTRUE)
+        service->release(view);
 }
\ No newline at end of file